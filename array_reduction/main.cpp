@@ -104,8 +104,14 @@ int main() {
   device.bindBufferMemory(buffer_array, mem_array, 0);
   device.bindBufferMemory(buffer_sum, mem_sum, 0);
   device.bindBufferMemory(buffer_count, mem_count, 0);
-  //! 创建shader module
-  string spv_filename = "array_reduction.spv";
+  //! 创建shader module：compute shader支持subgroup arithmetic时用subgroupAdd规约
+  auto props = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceSubgroupProperties>();
+  auto &subgroup_props = props.get<vk::PhysicalDeviceSubgroupProperties>();
+  bool use_subgroup = (subgroup_props.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic) &&
+                      (subgroup_props.supportedStages & vk::ShaderStageFlagBits::eCompute);
+  cout << "[INFO] Subgroup size: " << subgroup_props.subgroupSize << ", reduce with "
+       << (use_subgroup ? "subgroupAdd" : "shared memory tree") << endl;
+  string spv_filename = use_subgroup ? "array_reduction_subgroup.spv" : "array_reduction.spv";
   ifstream file(spv_filename, ios::binary | ios::ate);
   if (!file.is_open()) {
     cout << "[ERROR] Failed to open shader file!" << endl;
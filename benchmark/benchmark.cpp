@@ -2,27 +2,51 @@
 #include "benchmark.h"
 #include <iostream>
 #include "shaders.hpp"
+#include "task_graph.h"
+#include "multi_device.h"
+#include "gpu_job.h"
+#include "pipeline_registry.h"
+#include "shader_compiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <random>
+#include <sstream>
+#include <thread>
 
-# define VK_CHECK(call) \
-{ \
-  auto res = vk::Result(call); \
-  if (vk::Result::eSuccess != res) { \
-    printf("[Error] vulkan call failed in %s:%d, result is %s\n",__FILE__,__LINE__, vk::to_string(res).c_str()); \
-    return false; \
-  } \
+using namespace std;
+
+/** 按名字取嵌入的SPIR-V，找不到时为空 */
+static span<const uint32_t> Spv(const string &name) {
+  return shader::Find(shader::comp_spv, name);
 }
 
-using namespace std;
+/** pipeline使用的shader名字。streaming和sum_inputs_reduction是同一个shader，只是pipeline layout不同 */
+static string ShaderName(const string &pipeline) {
+  return pipeline == "streaming" ? "sum_inputs_reduction" : pipeline;
+}
 
 void VkInfo::Destroy() {
 #ifdef USE_VMA
   vmaDestroyAllocator(allocator);
 #endif
+  if (layout_cache) {
+    layout_cache->Destroy();
+    delete layout_cache;
+    layout_cache = nullptr;
+  }
+  if (desc_allocator) {
+    desc_allocator->Destroy();
+    delete desc_allocator;
+    desc_allocator = nullptr;
+  }
   device.destroyCommandPool(cmd_pool);
-  device.destroyDescriptorPool(desc_pool);
   device.destroy();
-  instance.destroy();
+  if (owns_instance)
+    instance.destroy();
 }
 
 bool Buffer::Init(const VkInfo &info, size_t elem_size, size_t num, vk::BufferUsageFlags buff_usage,
@@ -65,41 +89,94 @@ bool Buffer::Init(const VkInfo &info, size_t elem_size, size_t num, vk::BufferUs
     printf("[FATAL] no property physical memory to crete Buffer\n");
     return false;
   }
+  mem_type_idx = alloc_info.memoryTypeIndex;
   VK_CHECK(device.allocateMemory(&alloc_info, nullptr, &mem));
   device.bindBufferMemory(buffer, mem, 0);
 #endif
   return true;
 }
 
+bool Buffer::InitAliased(const VkInfo &info, const Buffer &backing, size_t elem_size, size_t num,
+                         vk::BufferUsageFlags buff_usage) {
+  one_elem_size = elem_size;
+  num_elems = num;
+  size = one_elem_size * num_elems;
+  usage = buff_usage;
+  owns_memory = false;
+  if (size > backing.size) {
+    printf("[FATAL] aliased buffer is larger than its backing buffer\n");
+    return false;
+  }
+
+  vk::BufferCreateInfo buffer_info;
+  buffer_info.setSize(size);
+  buffer_info.setUsage(usage);
+  buffer_info.setSharingMode(vk::SharingMode::eExclusive);
+  buffer_info.setQueueFamilyIndices({info.queue_idx});
+#ifdef USE_VMA
+  allocator = info.allocator;
+  allocation = backing.allocation;
+  VkBuffer buf;
+  auto &c_buffer_info = static_cast<const VkBufferCreateInfo &>(buffer_info);
+  VK_CHECK(vmaCreateAliasingBuffer(allocator, allocation, &c_buffer_info, &buf));
+  buffer = buf;
+#else
+  device = info.device;
+  VK_CHECK(device.createBuffer(&buffer_info, nullptr, &buffer));
+  mem_req = device.getBufferMemoryRequirements(buffer);
+  mem_type_idx = backing.mem_type_idx;
+  if (!(mem_req.memoryTypeBits & (1u << mem_type_idx)) || mem_req.size > backing.mem_req.size) {
+    printf("[FATAL] memory of backing buffer is not compatible with aliased buffer\n");
+    device.destroyBuffer(buffer);
+    buffer = nullptr;
+    return false;
+  }
+  mem = backing.mem;
+  device.bindBufferMemory(buffer, mem, 0);
+#endif
+  return true;
+}
+
 void Buffer::Destroy() {
+  if (!buffer) return;  // 没有创建或已经销毁
 #ifdef USE_VMA
-  vmaDestroyBuffer(allocator, buffer, allocation);
+  if (owns_memory) {
+    vmaDestroyBuffer(allocator, buffer, allocation);
+  } else {  // NOTE: aliasing的buffer要用vkDestroyBuffer销毁
+    VmaAllocatorInfo allocator_info;
+    vmaGetAllocatorInfo(allocator, &allocator_info);
+    vkDestroyBuffer(allocator_info.device, buffer, nullptr);
+  }
 #else
-  device.freeMemory(mem);
+  if (owns_memory)
+    device.freeMemory(mem);
   device.destroyBuffer(buffer);
+  mem = nullptr;
 #endif
+  buffer = nullptr;
 }
 
 
 template<typename T>
 bool Buffer::SetData(T *data, size_t num) {
-  if (num != num_elems) {
-    printf("[FATAL] set data failed, because src.size() != num_elems\n");
+  if (num > num_elems) {  // NOTE: 可以只写前num个元素
+    printf("[FATAL] set data failed, because src.size() > num_elems\n");
     return false;
   }
   if (sizeof(T) != one_elem_size) {
     printf("[FATAL] set data failed, because sizeof(T) != one_elem_size\n");
     return false;
   }
+  size_t bytes = num * one_elem_size;
   void *map_data;
 #ifdef USE_VMA
   VK_CHECK(vmaMapMemory(allocator, allocation, &map_data));
-  memcpy(map_data, data, size);
-  VK_CHECK(vmaFlushAllocation(allocator, allocation, 0, size)); // TODO: 失败了需要unmap嘛？如果是coherent的就不要这个了吗？
+  memcpy(map_data, data, bytes);
+  VK_CHECK(vmaFlushAllocation(allocator, allocation, 0, bytes)); // TODO: 失败了需要unmap嘛？如果是coherent的就不要这个了吗？
   vmaUnmapMemory(allocator, allocation);
 #else
   VK_CHECK(device.mapMemory(mem, 0, size, {}, &map_data));  // NOTE: 不能填写vk::MemoryMapFlagBits::ePlacedEXT
-  memcpy(map_data, data, size);
+  memcpy(map_data, data, bytes);
   device.unmapMemory(mem);
 #endif
   return true;
@@ -157,8 +234,10 @@ vk::DescriptorType ConvertVkBufferUsage2DescriptorType(vk::BufferUsageFlags usag
   return vk::DescriptorType::eSampler;  // 默认值
 }
 
-bool DescriptorSet::Init(const VkInfo &info, const std::vector<Buffer*> &buffers) {
+bool DescriptorSet::Init(const VkInfo &info, const std::vector<Buffer*> &buffers, bool push_mode) {
   device = info.device;
+  push = push_mode;
+  push_fn = push ? info.push_descriptor_fn : nullptr;
   //! 检查输入buffer
   for (auto &buf: buffers) {
     if (!buf->buffer) {
@@ -169,58 +248,461 @@ bool DescriptorSet::Init(const VkInfo &info, const std::vector<Buffer*> &buffers
   //! 创建descriptor set layout
   auto num = buffers.size();
   vector<vk::DescriptorSetLayoutBinding> bindings(num);
-  for (uint32_t i = 0; i<num;i++)
-    bindings[i] = {i, ConvertVkBufferUsage2DescriptorType(buffers[i]->usage), 1, vk::ShaderStageFlagBits::eCompute};
+  types.resize(num);
+  for (uint32_t i = 0; i<num;i++) {
+    types[i] = ConvertVkBufferUsage2DescriptorType(buffers[i]->usage);
+    bindings[i] = {i, types[i], 1, vk::ShaderStageFlagBits::eCompute};
+  }
 
-  vk::DescriptorSetLayoutCreateInfo layout_info;
-  layout_info.setBindings(bindings);
-  VK_CHECK(device.createDescriptorSetLayout(&layout_info, nullptr, &layout));
+  if (push_fn)  // NOTE: push descriptor layout不能用来分配set
+    return info.layout_cache->GetSetLayout(bindings, layout, vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptorKHR);
+  if (!info.layout_cache->GetSetLayout(bindings, layout) ||
+      !info.layout_cache->GetUpdateTemplate(layout, bindings, update_template))
+    return false;
+  if (push) return true;  // 每次dispatch时再从recorder的分配器分配
 
   //! 创建descriptor set
-  vk::DescriptorSetAllocateInfo set_info;
-  set_info.setDescriptorPool(info.desc_pool);
-  set_info.setPSetLayouts(&layout);
-  set_info.setDescriptorSetCount(1);
-  VK_CHECK(device.allocateDescriptorSets(&set_info, &set));
+  if (!info.desc_allocator->Allocate(layout, types, set))
+    return false;
+  Update(buffers);
+  return true;
+}
+
+void DescriptorSet::Update(const std::vector<Buffer*> &buffers) {
   //! 写descriptor set
-  vector<vk::DescriptorBufferInfo> buffer_info(num);
-  vector<vk::WriteDescriptorSet> write_set(num);
-  for (uint32_t i = 0; i<num; i++) {
-    auto buffer = buffers[i];
-    buffer_info[i].setBuffer(buffer->buffer);
-    buffer_info[i].setOffset(0);
-    buffer_info[i].setRange(buffer->size);
+  auto num = buffers.size();
+  buffer_infos.resize(num);
+  for (uint32_t i = 0; i<num; i++)
+    buffer_infos[i] = {buffers[i]->buffer, 0, buffers[i]->size};
+  Update(buffer_infos);
+}
 
-    write_set[i] = {set, i, 0, 1, ConvertVkBufferUsage2DescriptorType(buffer->usage), nullptr, &buffer_info[i]};
+void DescriptorSet::Update(span<const vk::DescriptorBufferInfo> infos) {
+  // NOTE: 数量和layout不一致时template会越界读；转成void*以免匹配到按引用取数据的模板重载
+  device.updateDescriptorSetWithTemplate(set, update_template, static_cast<const void *>(infos.data()));
+}
+
+bool DescriptorAllocator::Init(const VkInfo &info, uint32_t initial_sets) {
+  device = info.device;
+  next_sets = max(initial_sets, 1u);
+  return true;  // NOTE: 第一次分配时才创建pool，这时已经知道需要哪些类型
+}
+
+bool DescriptorAllocator::NextPool(const unordered_map<vk::DescriptorType, uint32_t> &min_counts, bool &created) {
+  created = free_pools.empty();
+  if (!created) {
+    used_pools.push_back(free_pools.back());
+    free_pools.pop_back();
+    return true;
   }
-  device.updateDescriptorSets(write_set, nullptr);  // TODO: 需要descriptor copy嘛？
+  //! 每种类型的数量 = 平均每个set的需求 * set数量，至少能放下当前的set
+  uint32_t max_sets = next_sets;
+  vector<vk::DescriptorPoolSize> pool_sizes;
+  for (auto &[type, count]: demand) {
+    auto num = uint32_t(ceil(double(count) * max_sets / (total_allocated + 1)));
+    auto it = min_counts.find(type);
+    pool_sizes.push_back({type, max(num, it != min_counts.end() ? it->second : 1u)});
+  }
+  vk::DescriptorPoolCreateInfo create_info;
+  create_info.setMaxSets(max_sets);
+  create_info.setPoolSizes(pool_sizes);
+  vk::DescriptorPool pool;
+  VK_CHECK(device.createDescriptorPool(&create_info, nullptr, &pool));
+  used_pools.push_back({pool, max_sets});
+  next_sets = min(next_sets * 2, 4096u);
+  num_pools++;
   return true;
 }
 
-void DescriptorSet::Destroy() {
-  device.destroyDescriptorSetLayout(layout);
+bool DescriptorAllocator::Allocate(vk::DescriptorSetLayout layout, const vector<vk::DescriptorType> &types,
+                                   vk::DescriptorSet &set) {
+  lock_guard<mutex> lock(alloc_mutex);
+  unordered_map<vk::DescriptorType, uint32_t> counts;
+  for (auto type: types) {
+    counts[type]++;
+    demand[type]++;
+  }
+  bool created = false;
+  if (used_pools.empty() && !NextPool(counts, created))
+    return false;
+  vk::DescriptorSetAllocateInfo set_info(used_pools.back().pool, 1, &layout);
+  auto res = device.allocateDescriptorSets(&set_info, &set);
+  //! 当前pool用完或碎片化时换下一个pool。新建的pool一定能放下，复用的pool可能不够
+  while ((res == vk::Result::eErrorOutOfPoolMemory || res == vk::Result::eErrorFragmentedPool) && !created) {
+    if (!NextPool(counts, created))
+      return false;
+    set_info.setDescriptorPool(used_pools.back().pool);
+    res = device.allocateDescriptorSets(&set_info, &set);
+  }
+  VK_CHECK(res);
+  num_allocated++;
+  total_allocated++;
+  return true;
 }
 
+bool DescriptorAllocator::Reset() {
+  lock_guard<mutex> lock(alloc_mutex);
+  for (auto &pool: used_pools) {
+    device.resetDescriptorPool(pool.pool);
+    free_pools.push_back(pool);
+  }
+  used_pools.clear();
+  num_allocated = 0;
+  num_resets++;
+  return true;
+}
+
+void DescriptorAllocator::Destroy() {
+  for (auto &pool: used_pools)
+    device.destroyDescriptorPool(pool.pool);
+  for (auto &pool: free_pools)
+    device.destroyDescriptorPool(pool.pool);
+  used_pools.clear();
+  free_pools.clear();
+}
 
-bool Pipeline::Init(const VkInfo &info, const DescriptorSet &desc, const vector<uint32_t> &shader_code) {
+void DescriptorAllocator::PrintStats(const char *name) const {
+  uint32_t capacity = 0;
+  for (auto &pool: used_pools)
+    capacity += pool.max_sets;
+  printf("[INFO] %s descriptor allocator: %u pools created, %zu in use, %u/%u sets used (%.1f%%), "
+         "%llu sets allocated, %u resets\n", name, num_pools, used_pools.size(), num_allocated, capacity,
+    capacity ? num_allocated * 100.0 / capacity : 0.0, (unsigned long long)total_allocated, num_resets);
+  for (auto &[type, count]: demand)
+    printf("[INFO]   %-14s %.2f per set\n", vk::to_string(type).c_str(), double(count) / max<uint64_t>(total_allocated, 1));
+}
+
+bool BindlessTable::Init(const VkInfo &info, uint32_t max_buffers) {
   device = info.device;
+  if (!info.bindless_supported) {
+    printf("[ERROR] descriptor indexing is not supported, cannot create bindless table\n");
+    return false;
+  }
+  auto props = info.phy_device.getProperties2<vk::PhysicalDeviceProperties2,
+                                              vk::PhysicalDeviceDescriptorIndexingProperties>();
+  auto &limits = props.get<vk::PhysicalDeviceDescriptorIndexingProperties>();
+  capacity = min({max_buffers, limits.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                  limits.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+  //! 创建layout：没注册的下标可以是无效的（partially bound），使用中也可以注册新的（update after bind）
+  vk::DescriptorSetLayoutBinding binding(0, vk::DescriptorType::eStorageBuffer, capacity,
+                                         vk::ShaderStageFlagBits::eCompute);
+  vk::DescriptorBindingFlags binding_flags = vk::DescriptorBindingFlagBits::ePartiallyBound |
+                                             vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+  vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_info;
+  flags_info.setBindingFlags(binding_flags);
+  vk::DescriptorSetLayoutCreateInfo layout_info;
+  layout_info.setFlags(vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool);
+  layout_info.setBindings(binding);
+  layout_info.setPNext(&flags_info);
+  VK_CHECK(device.createDescriptorSetLayout(&layout_info, nullptr, &desc.layout));
+  //! 创建只有一个set的pool
+  vk::DescriptorPoolSize pool_size(vk::DescriptorType::eStorageBuffer, capacity);
+  vk::DescriptorPoolCreateInfo pool_info;
+  pool_info.setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind);
+  pool_info.setMaxSets(1);
+  pool_info.setPoolSizes(pool_size);
+  VK_CHECK(device.createDescriptorPool(&pool_info, nullptr, &pool));
+  vk::DescriptorSetAllocateInfo set_info(pool, 1, &desc.layout);
+  VK_CHECK(device.allocateDescriptorSets(&set_info, &desc.set));
+  desc.device = device;
+  desc.types = {vk::DescriptorType::eStorageBuffer};
+  num_used = 0;
+  free_slots.clear();
+  return true;
+}
+
+uint32_t BindlessTable::Register(const Buffer &buffer, vk::DeviceSize offset, vk::DeviceSize size) {
+  lock_guard<mutex> lock(table_mutex);
+  uint32_t idx;
+  if (!free_slots.empty()) {
+    idx = free_slots.back();
+    free_slots.pop_back();
+  } else if (num_used < capacity) {
+    idx = num_used++;
+  } else {
+    printf("[ERROR] bindless table is full (%u buffers)\n", capacity);
+    return UINT32_MAX;
+  }
+  vk::DescriptorBufferInfo buffer_info(buffer.buffer, offset, size);
+  vk::WriteDescriptorSet write(desc.set, 0, idx, 1, vk::DescriptorType::eStorageBuffer, nullptr, &buffer_info);
+  device.updateDescriptorSets(write, nullptr);
+  return idx;
+}
+
+void BindlessTable::Unregister(uint32_t idx) {
+  lock_guard<mutex> lock(table_mutex);
+  free_slots.push_back(idx);  // NOTE: partially bound，旧的descriptor只要不被访问就不需要清除
+}
+
+void BindlessTable::Destroy() {
+  //! Init可能在中途失败，每个句柄单独判断
+  if (pool) {
+    device.destroyDescriptorPool(pool);  // 同时释放了set
+    pool = nullptr;
+  }
+  if (desc.layout)  // NOTE: 这个layout不在LayoutCache中，需要自己销毁
+    device.destroyDescriptorSetLayout(desc.layout);
+  desc.Destroy();
+  desc.set = nullptr;
+}
+
+void DescriptorSet::Destroy() {
+  layout = nullptr;  // NOTE: layout和update template由LayoutCache销毁
+  update_template = nullptr;
+}
+
+
+uint64_t HashShaderCode(span<const uint32_t> code, uint64_t seed) {
+  uint64_t hash = seed;
+  auto bytes = reinterpret_cast<const uint8_t *>(code.data());
+  for (size_t i = 0; i < code.size() * sizeof(uint32_t); i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool LayoutCache::GetSetLayout(const vector<vk::DescriptorSetLayoutBinding> &bindings,
+                               vk::DescriptorSetLayout &layout, vk::DescriptorSetLayoutCreateFlags flags) {
+  vector<uint32_t> key = {uint32_t(flags)};
+  for (auto &binding: bindings)
+    key.insert(key.end(), {binding.binding, uint32_t(binding.descriptorType), binding.descriptorCount,
+                           uint32_t(binding.stageFlags)});
+  lock_guard<mutex> lock(layout_mutex);
+  auto it = set_layouts.find(key);
+  if (it != set_layouts.end()) {
+    layout = it->second;
+    num_reused++;
+    return true;
+  }
+  vk::DescriptorSetLayoutCreateInfo layout_info;
+  layout_info.setFlags(flags);
+  layout_info.setBindings(bindings);
+  VK_CHECK(device.createDescriptorSetLayout(&layout_info, nullptr, &layout));
+  set_layouts[key] = layout;
+  return true;
+}
+
+bool LayoutCache::GetUpdateTemplate(vk::DescriptorSetLayout set_layout,
+                                    const vector<vk::DescriptorSetLayoutBinding> &bindings,
+                                    vk::DescriptorUpdateTemplate &update_template) {
+  lock_guard<mutex> lock(layout_mutex);
+  auto it = update_templates.find(set_layout);
+  if (it != update_templates.end()) {
+    update_template = it->second;
+    num_reused++;
+    return true;
+  }
+  //! 第i个binding从数据的第i个vk::DescriptorBufferInfo读取
+  vector<vk::DescriptorUpdateTemplateEntry> entries(bindings.size());
+  for (uint32_t i = 0; i < bindings.size(); i++)
+    entries[i] = {bindings[i].binding, 0, bindings[i].descriptorCount, bindings[i].descriptorType,
+                  i * sizeof(vk::DescriptorBufferInfo), sizeof(vk::DescriptorBufferInfo)};
+  vk::DescriptorUpdateTemplateCreateInfo template_info;
+  template_info.setDescriptorUpdateEntries(entries);
+  template_info.setTemplateType(vk::DescriptorUpdateTemplateType::eDescriptorSet);
+  template_info.setDescriptorSetLayout(set_layout);
+  VK_CHECK(device.createDescriptorUpdateTemplate(&template_info, nullptr, &update_template));
+  update_templates[set_layout] = update_template;
+  return true;
+}
+
+bool LayoutCache::GetPipelineLayout(vk::DescriptorSetLayout set_layout, uint32_t push_constant_size,
+                                    vk::PipelineLayout &layout) {
+  // NOTE: set layout已经去重，相同签名的handle相同，可以直接作为key
+  auto handle = uint64_t(VkDescriptorSetLayout(set_layout));
+  vector<uint32_t> key = {uint32_t(handle), uint32_t(handle >> 32), push_constant_size};
+  lock_guard<mutex> lock(layout_mutex);
+  auto it = pipeline_layouts.find(key);
+  if (it != pipeline_layouts.end()) {
+    layout = it->second;
+    num_reused++;
+    return true;
+  }
   vk::PipelineLayoutCreateInfo layout_info;
-  layout_info.setSetLayouts({desc.layout});
+  layout_info.setSetLayouts({set_layout});
+  vk::PushConstantRange push_range(vk::ShaderStageFlagBits::eCompute, 0, push_constant_size);
+  if (push_constant_size > 0)
+    layout_info.setPushConstantRanges({push_range});
   VK_CHECK(device.createPipelineLayout(&layout_info, nullptr, &layout));
+  pipeline_layouts[key] = layout;
+  return true;
+}
+
+void LayoutCache::Destroy() {
+  for (auto &update_template: update_templates)
+    device.destroyDescriptorUpdateTemplate(update_template.second);
+  update_templates.clear();
+  for (auto &layout: pipeline_layouts)
+    device.destroyPipelineLayout(layout.second);
+  for (auto &layout: set_layouts)
+    device.destroyDescriptorSetLayout(layout.second);
+  pipeline_layouts.clear();
+  set_layouts.clear();
+}
+
+void TuningDb::Load(const string &file, const vk::PhysicalDevice &phy_device) {
+  auto props = phy_device.getProperties();
+  char key[64];
+  snprintf(key, sizeof(key), "%04x-%04x-%08x", props.vendorID, props.deviceID, props.driverVersion);
+  path = file;
+  device_key = key;
+  configs.clear();
+  ifstream in(path);
+  string line;
+  while (getline(in, line)) {
+    istringstream ss(line);
+    string device, kernel;
+    TuneConfig config;
+    if (ss >> device >> kernel >> config.workgroup_size >> config.elems_per_thread >> config.ms &&
+        device == device_key && config.workgroup_size > 0 && config.elems_per_thread > 0)
+      configs[kernel] = config;
+  }
+  if (!configs.empty())
+    printf("[INFO] Loaded %zu tuned kernels of device %s from %s\n", configs.size(), key, path.c_str());
+}
+
+bool TuningDb::Save() {
+  //! 保留其他设备的结果
+  vector<string> lines;
+  {
+    ifstream in(path);
+    string line;
+    while (getline(in, line))
+      if (line.compare(0, device_key.size() + 1, device_key + " ") != 0)
+        lines.push_back(line);
+  }
+  string tmp_path = path + ".tmp";
+  {
+    ofstream file(tmp_path, ios::trunc);
+    for (auto &line: lines)
+      file << line << "\n";
+    for (auto &config: configs)
+      file << device_key << " " << config.first << " " << config.second.workgroup_size << " "
+           << config.second.elems_per_thread << " " << config.second.ms << "\n";
+    if (!file) {
+      printf("[ERROR] failed to write tuning database %s\n", tmp_path.c_str());
+      return false;
+    }
+  }
+  error_code ec;
+  filesystem::rename(tmp_path, path, ec);
+  if (ec) {
+    printf("[ERROR] failed to save tuning database %s: %s\n", path.c_str(), ec.message().c_str());
+    filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  printf("[INFO] Tuning database %s: saved %zu kernels of device %s\n", path.c_str(), configs.size(),
+    device_key.c_str());
+  return true;
+}
+
+const TuneConfig *TuningDb::Get(const string &kernel) const {
+  auto it = configs.find(kernel);
+  return it == configs.end() ? nullptr : &it->second;
+}
+
+bool PipelineCache::Init(const VkInfo &info, const string &dir, uint64_t shader_hash) {
+  device = info.device;
+  auto props = info.phy_device.getProperties();
+  //! 文件名：设备UUID_驱动版本_shader hash
+  char key[128];
+  int len = 0;
+  for (auto byte: props.pipelineCacheUUID)
+    len += snprintf(key + len, sizeof(key) - len, "%02x", byte);
+  snprintf(key + len, sizeof(key) - len, "_%08x_%016llx", props.driverVersion, (unsigned long long)shader_hash);
+  path = dir + "/pipeline_cache_" + key + ".bin";
+  //! 读取并校验header
+  vector<char> data;
+  ifstream file(path, ios::binary | ios::ate);
+  if (file.is_open()) {
+    data.resize(file.tellg());
+    file.seekg(0);
+    file.read(data.data(), data.size());
+    if (!file) data.clear();
+  }
+  vk::PipelineCacheHeaderVersionOne header;
+  if (data.size() >= sizeof(header)) {
+    memcpy(&header, data.data(), sizeof(header));
+    bool valid = header.headerSize >= sizeof(header) && header.headerSize <= data.size() &&
+                 header.headerVersion == vk::PipelineCacheHeaderVersion::eOne &&
+                 header.vendorID == props.vendorID && header.deviceID == props.deviceID &&
+                 memcmp(header.pipelineCacheUUID.data(), props.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
+    if (!valid) {
+      printf("[WARNING] pipeline cache %s does not match this device, ignore it\n", path.c_str());
+      data.clear();
+    }
+  } else if (!data.empty()) {
+    printf("[WARNING] pipeline cache %s is truncated, ignore it\n", path.c_str());
+    data.clear();
+  }
+  vk::PipelineCacheCreateInfo cache_info;
+  cache_info.setInitialDataSize(data.size()).setPInitialData(data.data());
+  if (device.createPipelineCache(&cache_info, nullptr, &cache) != vk::Result::eSuccess) {
+    //! 驱动仍然拒绝这份数据时，退回到空cache
+    printf("[WARNING] failed to load pipeline cache %s, start with an empty one\n", path.c_str());
+    data.clear();
+    cache_info.setInitialDataSize(0).setPInitialData(nullptr);
+    VK_CHECK(device.createPipelineCache(&cache_info, nullptr, &cache));
+  }
+  printf("[INFO] Pipeline cache %s: loaded %zu bytes\n", path.c_str(), data.size());
+  return true;
+}
+
+bool PipelineCache::Save() {
+  vector<uint8_t> data = device.getPipelineCacheData(cache);
+  string tmp_path = path + ".tmp";
+  {
+    ofstream file(tmp_path, ios::binary | ios::trunc);
+    file.write(reinterpret_cast<const char *>(data.data()), data.size());
+    if (!file) {
+      printf("[ERROR] failed to write pipeline cache %s\n", tmp_path.c_str());
+      return false;
+    }
+  }
+  error_code ec;
+  filesystem::rename(tmp_path, path, ec);  // NOTE: 同一文件系统内的rename是原子的
+  if (ec) {
+    printf("[ERROR] failed to save pipeline cache %s: %s\n", path.c_str(), ec.message().c_str());
+    filesystem::remove(tmp_path, ec);
+    return false;
+  }
+  printf("[INFO] Pipeline cache %s: saved %zu bytes\n", path.c_str(), data.size());
+  return true;
+}
+
+void PipelineCache::Destroy() {
+  if (cache) device.destroyPipelineCache(cache);
+  cache = nullptr;
+}
+
+bool Pipeline::Init(const VkInfo &info, const DescriptorSet &desc, span<const uint32_t> shader_code,
+                    vk::PipelineCache cache, const SpecConstants &spec, uint32_t push_constant_size) {
+  device = info.device;
+  this->push_constant_size = push_constant_size;
+  if (!info.layout_cache->GetPipelineLayout(desc.layout, push_constant_size, layout))
+    return false;
 
   vk::ShaderModuleCreateInfo shader_info;
-  shader_info.setCode(shader_code); // 等价于下面两行
-  // shader_info.setCodeSize(shader_code.size() * sizeof(uint32_t));
-  // shader_info.setPCode(shader_code.data());
+  shader_info.setCodeSize(shader_code.size() * sizeof(uint32_t));
+  shader_info.setPCode(shader_code.data());
   VK_CHECK(device.createShaderModule(&shader_info, nullptr, &shader_module));
 
-  vk::PipelineCacheCreateInfo cache_info; // TODO: 完善
-  VK_CHECK(device.createPipelineCache(&cache_info, nullptr, &cache));
-
   vk::PipelineShaderStageCreateInfo stage_info;
   stage_info.setStage(vk::ShaderStageFlagBits::eCompute);
   stage_info.setModule(shader_module);
   stage_info.setPName("main");
+  //! 特化常量，每个都是uint32_t
+  vector<vk::SpecializationMapEntry> spec_entries(spec.size());
+  for (uint32_t i = 0; i < spec.size(); i++)
+    spec_entries[i] = {i, i * uint32_t(sizeof(uint32_t)), sizeof(uint32_t)};
+  vk::SpecializationInfo spec_info;
+  spec_info.setMapEntries(spec_entries);
+  spec_info.setDataSize(spec.size() * sizeof(uint32_t));
+  spec_info.setPData(spec.data());
+  if (!spec.empty())
+    stage_info.setPSpecializationInfo(&spec_info);
+  local_size_x = spec.empty() ? 0 : spec[0];
 
   vk::ComputePipelineCreateInfo pipeline_info;
   pipeline_info.setLayout(layout);
@@ -231,17 +713,202 @@ bool Pipeline::Init(const VkInfo &info, const DescriptorSet &desc, const vector<
 }
 
 void Pipeline::Destroy() {
+  if (!device) return;  // 没有创建或已经销毁
   device.destroyPipeline(pipeline);
-  device.destroyPipelineLayout(layout);
-  device.destroyPipelineCache(cache);
   device.destroyShaderModule(shader_module);
+  device = nullptr;
+}
+void CommandRecorder::Begin(vk::CommandBuffer cmd_buffer, bool one_time_submit) {
+  cmd = cmd_buffer;
+  num_barriers = 0;
+  states_.clear();  // NOTE: 每次submit之前都会等fence，所以不跟踪跨command buffer的状态
+  bound_pipeline_ = nullptr;
+  bound_layout_ = nullptr;
+  bound_set_ = nullptr;
+  vk::CommandBufferBeginInfo begin_info;
+  if (one_time_submit)
+    begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+  cmd.begin(begin_info);
+}
+
+void CommandRecorder::End() {
+  cmd.end();
 }
-// bool Barrier::Init() {
-//   barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
-//   barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-// }
 
-Benchmark::Benchmark(int elem_num): elem_num_(elem_num) {
+void CommandRecorder::Sync(const vector<BufferAccess> &accesses) {
+  vector<vk::BufferMemoryBarrier> barriers;
+  vk::PipelineStageFlags src_stages, dst_stages;
+  PlanBarriers(accesses, barriers, src_stages, dst_stages);
+  if (barriers.empty()) return;
+  cmd.pipelineBarrier(src_stages, dst_stages, {}, nullptr, barriers, nullptr);
+  num_barriers++;
+}
+
+void CommandRecorder::PlanBarriers(const vector<BufferAccess> &accesses, vector<vk::BufferMemoryBarrier> &barriers,
+                                   vk::PipelineStageFlags &src_stages, vk::PipelineStageFlags &dst_stages) {
+  auto add_barrier = [&](const BufferAccess &acc, vk::PipelineStageFlags src_stage, vk::AccessFlags src_access,
+                         vk::PipelineStageFlags dst_stage, vk::AccessFlags dst_access) {
+    vk::BufferMemoryBarrier barrier;
+    barrier.setSrcAccessMask(src_access).setDstAccessMask(dst_access);
+    barrier.setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED).setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+    barrier.setBuffer(acc.buffer->buffer).setOffset(acc.offset).setSize(acc.size);
+    barriers.push_back(barrier);
+    src_stages |= src_stage;
+    dst_stages |= dst_stage;
+  };
+  for (auto &acc: accesses) {
+    bool is_read = acc.access != Access::eWrite;
+    bool is_write = acc.access == Access::eWrite || acc.access == Access::eReadWrite;
+    vk::PipelineStageFlags stage = vk::PipelineStageFlagBits::eComputeShader;
+    vk::AccessFlags access;
+    if (acc.access == Access::eIndirect) {
+      stage = vk::PipelineStageFlagBits::eDrawIndirect;  // NOTE: dispatchIndirect在DRAW_INDIRECT阶段读参数
+      access = vk::AccessFlagBits::eIndirectCommandRead;
+    } else {
+      if (is_read)
+        access |= acc.buffer->usage & vk::BufferUsageFlagBits::eUniformBuffer ? vk::AccessFlagBits::eUniformRead
+                                                                               : vk::AccessFlagBits::eShaderRead;
+      if (is_write)
+        access |= vk::AccessFlagBits::eShaderWrite;
+    }
+
+    auto &state = states_[static_cast<VkBuffer>(acc.buffer->buffer)];
+    if (is_write) {
+      if (state.write_stages)       // WAW：需要等上次写完成且可见，同时等上次写之后的读完成（WAR）
+        add_barrier(acc, state.write_stages | state.read_stages, state.write_access, stage, access);
+      else if (state.read_stages)   // WAR：只需要执行依赖
+        add_barrier(acc, state.read_stages, {}, stage, {});
+      state = {stage, vk::AccessFlagBits::eShaderWrite, {}, {}, {}};
+      continue;
+    }
+    // RAW：这个stage上还没有同步过上次的写
+    if (state.write_stages && ((state.visible_stages & stage) != stage || (state.visible_access & access) != access)) {
+      add_barrier(acc, state.write_stages, state.write_access, stage, access);
+      state.visible_stages |= stage;
+      state.visible_access |= access;
+    }
+    state.read_stages |= stage;
+  }
+}
+
+void CommandRecorder::Bind(const Pipeline &pipeline, const DescriptorSet &desc) {
+  if (pipeline.pipeline != bound_pipeline_) {
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.pipeline);
+    bound_pipeline_ = pipeline.pipeline;
+  }
+  if (desc.set != bound_set_ || pipeline.layout != bound_layout_) {
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, {desc.set}, {});
+    bound_set_ = desc.set;
+    bound_layout_ = pipeline.layout;
+  }
+}
+
+void CommandRecorder::Dispatch(const Pipeline &pipeline, const DescriptorSet &desc, uint32_t x, uint32_t y,
+                               uint32_t z, const vector<BufferAccess> &accesses) {
+  Sync(accesses);
+  Bind(pipeline, desc);
+  cmd.dispatch(x, y, z);  // 设置grid size  // NOTE: GLSL中设置的是block size
+}
+
+bool CommandRecorder::DispatchPush(const Pipeline &pipeline, const DescriptorSet &desc,
+                                   const vector<BufferAccess> &bindings, uint32_t x, uint32_t y, uint32_t z) {
+  Sync(bindings);
+  if (pipeline.pipeline != bound_pipeline_) {
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline.pipeline);
+    bound_pipeline_ = pipeline.pipeline;
+  }
+  bound_set_ = nullptr;  // NOTE: 之后的Dispatch需要重新绑定set
+  auto num = uint32_t(bindings.size());
+  vector<vk::DescriptorBufferInfo> infos(num);
+  for (uint32_t i = 0; i < num; i++)
+    infos[i] = {bindings[i].buffer->buffer, bindings[i].offset, bindings[i].size};
+  if (desc.push_fn) {
+    //! 直接写进command buffer，不需要descriptor set
+    vector<vk::WriteDescriptorSet> writes(num);
+    for (uint32_t i = 0; i < num; i++)
+      writes[i] = {nullptr, i, 0, 1, desc.types[i], nullptr, &infos[i]};
+    desc.push_fn(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0, num,
+      reinterpret_cast<const VkWriteDescriptorSet *>(writes.data()));
+  } else {
+    //! 从本帧的线性分配器分配一个set，帧结束后统一回收
+    if (!desc_allocator) {
+      printf("[ERROR] push descriptor is not supported and no descriptor allocator is set\n");
+      return false;
+    }
+    vk::DescriptorSet set;
+    if (!desc_allocator->Allocate(desc.layout, desc.types, set))
+      return false;
+    desc.device.updateDescriptorSetWithTemplate(set, desc.update_template, static_cast<const void *>(infos.data()));
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline.layout, 0, {set}, {});
+  }
+  cmd.dispatch(x, y, z);
+  return true;
+}
+
+void CommandRecorder::DispatchIndirect(const Pipeline &pipeline, const DescriptorSet &desc, Buffer &args,
+                                       const vector<BufferAccess> &accesses) {
+  auto all_accesses = accesses;
+  all_accesses.push_back({&args, Access::eIndirect});
+  Sync(all_accesses);
+  Bind(pipeline, desc);
+  cmd.dispatchIndirect(args.buffer, 0);
+}
+
+bool WaitFence(vk::Device device, vk::Fence fence, WaitPolicy policy, uint32_t spin_us) {
+  if (policy != WaitPolicy::eBlock) {
+    auto deadline = chrono::steady_clock::now() + chrono::microseconds(spin_us);
+    while (policy == WaitPolicy::eSpin || chrono::steady_clock::now() < deadline) {
+      auto res = device.getFenceStatus(fence);
+      if (res == vk::Result::eSuccess) return true;
+      if (res != vk::Result::eNotReady) {
+        printf("[Error] get fence status failed, result is %s\n", vk::to_string(res).c_str());
+        return false;
+      }
+    }
+  }
+  VK_CHECK(device.waitForFences(1, &fence, VK_TRUE, UINT64_MAX));
+  return true;
+}
+
+bool GpuTimer::Init(const VkInfo &info, uint32_t num_timestamps) {
+  device = info.device;
+  auto props = info.phy_device.getProperties();
+  auto valid_bits = info.phy_device.getQueueFamilyProperties()[info.queue_idx].timestampValidBits;
+  if (valid_bits == 0) {
+    printf("[ERROR] queue family %u does not support timestamps\n", info.queue_idx);
+    return false;
+  }
+  period = props.limits.timestampPeriod;
+  valid_mask = valid_bits >= 64 ? UINT64_MAX : (1ull << valid_bits) - 1;
+  num_queries = num_timestamps;
+  vk::QueryPoolCreateInfo create_info({}, vk::QueryType::eTimestamp, num_queries);
+  VK_CHECK(device.createQueryPool(&create_info, nullptr, &pool));
+  return true;
+}
+
+void GpuTimer::Destroy() {
+  if (pool) device.destroyQueryPool(pool);
+  pool = nullptr;
+}
+
+void GpuTimer::Reset(vk::CommandBuffer cmd) {
+  cmd.resetQueryPool(pool, 0, num_queries);
+}
+
+void GpuTimer::Mark(vk::CommandBuffer cmd, uint32_t idx) {
+  cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, pool, idx);
+}
+
+bool GpuTimer::GetElapsed(uint32_t begin, uint32_t end, double &ms) {
+  vector<uint64_t> ticks(num_queries);
+  VK_CHECK(device.getQueryPoolResults(pool, 0, num_queries, ticks.size() * sizeof(uint64_t), ticks.data(),
+    sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait));
+  ms = double((ticks[end] - ticks[begin]) & valid_mask) * period * 1e-6;
+  return true;
+}
+
+Benchmark::Benchmark(int elem_num, bool lazy)
+    : pipelines_(make_unique<PipelineRegistry>()), elem_num_(elem_num), lazy_(lazy) {
   create_succrss_ = false;
   //! 初始化 Vulkan 环境
   if (!InitVkInfo()) {
@@ -269,15 +936,24 @@ Benchmark::Benchmark(int elem_num): elem_num_(elem_num) {
     printf("[FATAL] Failed to create fence.\n");
     return;
   }
+  if (!timer_.Init(vk_info_, 4)) {
+    printf("[FATAL] Failed to create GPU timer.\n");
+    return;
+  }
   create_succrss_ = true;
 }
 Benchmark::~Benchmark() {
   // 清理
   if (create_succrss_) {
     vk_info_.device.destroyFence(fence_);
+    timer_.Destroy();
+    pipelines_->Destroy();  // 先等warmup线程结束
+    bindless_.Destroy();
+    if (lazy_)
+      pipeline_cache_.Save();  // 保存运行过程中编译的pipeline
+    pipeline_cache_.Destroy();
     buffers_.clear();
     desc_sets_.clear();
-    pipelines_.clear();
     vk_info_.Destroy();
   }
 }
@@ -289,47 +965,736 @@ bool Benchmark::Run() {
   vector<Input> data(elem_num_, Input(base_num));
   bool set_success = true;
   set_success &= buffers_["inputs"].SetData(data.data(), elem_num_);
-  set_success &= buffers_["num"].SetData<int>(&elem_num_, 1);
   set_success &= buffers_["sum"].SetZero();
   if (!set_success) {
     printf("[FATAL] Failed to set data.\n");
     return false;
   }
-  //! 执行GPU计算
-  vk::CommandBufferBeginInfo begin_info;
-  begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
-  cmd_buffer_.begin(begin_info);
-  cmd_buffer_.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_["sum_inputs"].pipeline);
-  cmd_buffer_.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelines_["sum_inputs"].layout, 0,
-    {desc_sets_["sum_inputs"].set}, {});
-  cmd_buffer_.dispatch(128, 1 ,1);  // 设置grid size  // NOTE: GLSL中设置的是block size
-  vk::MemoryBarrier barrier;  // NOTE: 不能用execution barrier，因为上个shader的数据可能仅在GPU缓存中
-  barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
-  barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
-  cmd_buffer_.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
-    vk::DependencyFlagBits::eByRegion, 1, &barrier, 0, nullptr, 0, nullptr);
-  cmd_buffer_.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines_["array_reduction"].pipeline);
-  cmd_buffer_.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelines_["array_reduction"].layout, 0,
-    {desc_sets_["array_reduction"].set}, {});
-  cmd_buffer_.dispatch(128, 1 ,1);  // 设置grid size  // NOTE: GLSL中设置的是block size
-  cmd_buffer_.end();
+  //! 执行GPU计算，设备支持时用subgroupAdd规约，不支持float原子加时用两遍规约
+  const char *reduction = ReductionKernel();
+  auto *dispatch_args = pipelines_->Get("dispatch_args"), *sum_inputs = pipelines_->Get("sum_inputs");
+  if (!dispatch_args || !sum_inputs) return false;
+  CommandRecorder recorder;
+  recorder.Begin(cmd_buffer_);
+  // NOTE: 所有pipeline的push constant范围相同，设置一次即可
+  recorder.PushConstants(*dispatch_args, Params{elem_num_});
+  if (!vk_info_.atomic_float_supported) {
+    recorder.Dispatch(*sum_inputs, desc_sets_["sum_inputs"], GridSize("sum_inputs", elem_num_),
+      1, 1, {{&buffers_["inputs"], Access::eRead}, {&buffers_["array"], Access::eWrite}});
+    if (!RecordTwoPassReduction(recorder, elem_num_)) return false;
+  } else {
+    auto *array_reduction = pipelines_->Get(reduction);
+    if (!array_reduction) return false;
+    // 在GPU上根据元素数量计算array_reduction的grid size，中间不需要回读到host
+    recorder.Dispatch(*dispatch_args, desc_sets_["dispatch_args"], 1, 1, 1,
+      {{&buffers_["dispatch_args"], Access::eWrite}});
+    // NOTE: 和dispatch_args之间没有依赖，不插barrier，可以并行执行
+    recorder.Dispatch(*sum_inputs, desc_sets_["sum_inputs"], GridSize("sum_inputs", elem_num_),
+      1, 1, {{&buffers_["inputs"], Access::eRead}, {&buffers_["array"], Access::eWrite}});
+    recorder.DispatchIndirect(*array_reduction, desc_sets_[reduction], buffers_["dispatch_args"],
+      {{&buffers_["array"], Access::eRead}, {&buffers_["sum"], Access::eReadWrite}});
+  }
+  recorder.End();
   vk::SubmitInfo submit_info;
   submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
   VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
   //! 输出GPU计算结果
-  VK_CHECK(vk_info_.device.waitForFences(1, &fence_, VK_TRUE, UINT64_MAX));
+  if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+  VK_CHECK(vk_info_.device.resetFences(1, &fence_));
   float sum;
   if (!buffers_["sum"].GetData(&sum, 1)) {
     printf("[FATAL] Failed to get data from GPU\n");
     return false;
   }
   printf("[INFO] Sum of array in GPU is %f\n", sum);
-  //! CPU计算结果
-  sum = elem_num_ * 3 * base_num;
-  printf("[INFO] Sum of array in CPU is %f\n", sum);
+  //! CPU计算结果，和GPU一样先用float算每个元素，再用double累加
+  double cpu_sum = 0;
+  for (auto &in: data)
+    cpu_sum += double(in.num1 + in.vec.x + float(in.num2));
+  printf("[INFO] Sum of array in CPU is %f, relative error %.3e\n", cpu_sum, fabs(sum - cpu_sum) / cpu_sum);
+  return true;
+}
+
+bool Benchmark::RunTaskGraph(int repeat) {
+  if (!RequireAtomicFloat("task graph")) return true;
+  printf("[INFO] Run task graph with %d elements for %d times\n", elem_num_, repeat);
+  //! 描述计算图
+  TaskGraph graph;
+  graph.AddBuffer("inputs", sizeof(Input), elem_num_, vk::BufferUsageFlagBits::eStorageBuffer, MEMORY_CPU_TO_GPU);
+  graph.AddBuffer("sum", sizeof(float), 1, vk::BufferUsageFlagBits::eStorageBuffer, MEMORY_GPU_TO_CPU);
+  graph.AddTransientBuffer("array", sizeof(float), elem_num_, vk::BufferUsageFlagBits::eStorageBuffer);
+  graph.AddTransientBuffer("dispatch_args", sizeof(vk::DispatchIndirectCommand), 1,
+    vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer);
+  graph.AddTask("dispatch_args", Spv("dispatch_args"),
+    {{"dispatch_args", Access::eWrite}}, 1);
+  graph.AddTask("sum_inputs", Spv("sum_inputs"),
+    {{"inputs", Access::eRead}, {"array", Access::eWrite}}, 128);
+  graph.AddIndirectTask("array_reduction", Spv("array_reduction"),
+    {{"array", Access::eRead}, {"sum", Access::eReadWrite}}, "dispatch_args");
+  for (auto &task: {"dispatch_args", "sum_inputs", "array_reduction"})
+    graph.SetPushConstants(task, {uint32_t(elem_num_), 0});  // Params{count, offset}
+  if (!graph.Compile(vk_info_)) {
+    printf("[FATAL] Failed to compile task graph.\n");
+    return false;
+  }
+  //! 初始化数据
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!graph.GetBuffer("inputs").SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  //! 重复执行
+  float sum = 0;
+  auto start = chrono::steady_clock::now();
+  for (int i = 0; i < repeat; i++) {
+    if (!graph.GetBuffer("sum").SetZero() || !graph.Execute()) {
+      printf("[FATAL] Failed to execute task graph.\n");
+      return false;
+    }
+  }
+  auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  if (!graph.GetBuffer("sum").GetData(&sum, 1)) {
+    printf("[FATAL] Failed to get data from GPU\n");
+    return false;
+  }
+  printf("[INFO] Sum of array in task graph is %f, %.3f ms per execution\n", sum, elapsed / repeat);
+  return true;
+}
+
+bool Benchmark::RunSubgroupCompare(int repeat) {
+  if (!subgroup_reduction_) {
+    printf("[INFO] Subgroup arithmetic is not supported, skip subgroup reduction comparison\n");
+    return true;
+  }
+  printf("[INFO] Compare tree and subgroup reduction, %d elements for %d times\n", elem_num_, repeat);
+  // NOTE: 两个kernel规约同一个array，sum累加了repeat次
+  const char *names[] = {"array_reduction", "array_reduction_subgroup"};
+  double ms[2];
+  for (int k = 0; k < 2; k++) {
+    auto *pipeline = pipelines_->Get(names[k]);
+    if (!pipeline || !buffers_["sum"].SetZero()) return false;
+    if (!MeasureDispatch(*pipeline, desc_sets_[names[k]], GridSize(names[k], elem_num_), repeat, ms[k]))
+      return false;
+    float sum;
+    if (!buffers_["sum"].GetData(&sum, 1)) return false;
+    printf("[INFO] %-24s sum %f, %.3f ms, %.2f GB/s\n", names[k], sum / repeat, ms[k],
+      elem_num_ * sizeof(float) / ms[k] * 1e-6);
+  }
+  printf("[INFO] Subgroup reduction speedup %.2fx\n", ms[0] / ms[1]);
+  return true;
+}
+
+bool Benchmark::RunDeterministic(int repeat) {
+  printf("[INFO] Compare deterministic two-pass reduction, %d elements for %d times\n", elem_num_, repeat);
+  auto *atomic = vk_info_.atomic_float_supported ? pipelines_->Get("array_reduction") : nullptr;
+  if (vk_info_.atomic_float_supported && !atomic) return false;
+  //! 每次单独提交并读回结果，和第一次的结果比较是否按位相同
+  auto measure = [&](bool two_pass, double &ms, float &first, int &num_same) -> bool {
+    ms = 0;
+    num_same = 0;
+    for (int r = 0; r < repeat; r++) {
+      if (!buffers_["sum"].SetZero()) return false;
+      CommandRecorder recorder;
+      recorder.Begin(cmd_buffer_);
+      timer_.Reset(cmd_buffer_);
+      timer_.Mark(cmd_buffer_, 0);
+      if (two_pass) {
+        if (!RecordTwoPassReduction(recorder, elem_num_)) return false;
+      } else {
+        recorder.PushConstants(*atomic, Params{elem_num_});
+        recorder.Dispatch(*atomic, desc_sets_["array_reduction"], GridSize("array_reduction", elem_num_), 1, 1,
+          {{&buffers_["array"], Access::eRead}, {&buffers_["sum"], Access::eReadWrite}});
+      }
+      timer_.Mark(cmd_buffer_, 1);
+      recorder.End();
+      vk::SubmitInfo submit_info;
+      submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+      VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+      if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+      VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+      double elapsed;
+      float sum;
+      if (!timer_.GetElapsed(0, 1, elapsed) || !buffers_["sum"].GetData(&sum, 1)) return false;
+      ms += elapsed / repeat;
+      if (r == 0) first = sum;
+      num_same += memcmp(&sum, &first, sizeof(float)) == 0;
+    }
+    return true;
+  };
+  double two_pass_ms, atomic_ms;
+  float two_pass_sum, atomic_sum;
+  int two_pass_same, atomic_same;
+  if (!measure(true, two_pass_ms, two_pass_sum, two_pass_same)) return false;
+  printf("[INFO] Two-pass reduction: sum %f, %.3f ms, %d/%d runs bitwise identical\n", two_pass_sum, two_pass_ms,
+    two_pass_same, repeat);
+  if (!atomic) return true;
+  if (!measure(false, atomic_ms, atomic_sum, atomic_same)) return false;
+  printf("[INFO] Atomic reduction:   sum %f, %.3f ms, %d/%d runs bitwise identical\n", atomic_sum, atomic_ms,
+    atomic_same, repeat);
+  printf("[INFO] Two-pass reduction speedup %.2fx\n", atomic_ms / two_pass_ms);
+  return true;
+}
+
+bool Benchmark::RunAccuracy(int repeat) {
+  printf("[INFO] Compare summation accuracy with %d random elements for %d times\n", elem_num_, repeat);
+  //! 随机输入，CPU上和GPU一样先用float算每个元素，再用double累加作为参考
+  mt19937 rng(42);
+  uniform_real_distribution<float> dist(0.f, 100.f);
+  vector<Input> data;
+  data.reserve(elem_num_);
+  double ref = 0;
+  for (int i = 0; i < elem_num_; i++) {
+    data.emplace_back(dist(rng));
+    auto &in = data.back();
+    ref += double(in.num1 + in.vec.x + float(in.num2));
+  }
+  auto *sum_inputs = pipelines_->Get("sum_inputs");
+  if (!sum_inputs || !buffers_["inputs"].SetData(data.data(), elem_num_)) return false;
+  //! 用sum_inputs算出array
+  CommandRecorder recorder;
+  recorder.Begin(cmd_buffer_);
+  recorder.PushConstants(*sum_inputs, Params{elem_num_});
+  recorder.Dispatch(*sum_inputs, desc_sets_["sum_inputs"], GridSize("sum_inputs", elem_num_), 1, 1,
+    {{&buffers_["inputs"], Access::eRead}, {&buffers_["array"], Access::eWrite}});
+  recorder.End();
+  vk::SubmitInfo submit_info;
+  submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+  VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+  if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+  VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+  printf("[INFO] CPU double reference %.6f\n", ref);
+  //! 两遍的普通求和、补偿求和，以及设备支持时一遍的原子加求和
+  vector<string> kernels = {"array_reduction_two_pass", "array_reduction_kahan"};
+  if (vk_info_.atomic_float_supported)
+    kernels.push_back("array_reduction");
+  for (auto &kernel: kernels) {
+    auto *pipeline = pipelines_->Get(kernel);
+    if (!pipeline) return false;
+    double ms = 0;
+    float sum = 0;
+    for (int r = 0; r < repeat; r++) {
+      if (!buffers_["sum"].SetZero()) return false;
+      recorder.Begin(cmd_buffer_);
+      timer_.Reset(cmd_buffer_);
+      timer_.Mark(cmd_buffer_, 0);
+      if (kernel == "array_reduction") {
+        recorder.PushConstants(*pipeline, Params{elem_num_});
+        recorder.Dispatch(*pipeline, desc_sets_[kernel], GridSize(kernel, elem_num_), 1, 1,
+          {{&buffers_["array"], Access::eRead}, {&buffers_["sum"], Access::eReadWrite}});
+      } else if (!RecordTwoPassReduction(recorder, elem_num_, kernel)) {
+        return false;
+      }
+      timer_.Mark(cmd_buffer_, 1);
+      recorder.End();
+      VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+      if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+      VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+      double elapsed;
+      if (!timer_.GetElapsed(0, 1, elapsed) || !buffers_["sum"].GetData(&sum, 1)) return false;
+      ms += elapsed / repeat;
+    }
+    printf("[INFO] %-24s sum %.6f, relative error %.3e, %.3f ms, %.2f GB/s\n", kernel.c_str(), sum,
+      fabs(sum - ref) / ref, ms, elem_num_ * sizeof(float) / ms * 1e-6);
+  }
+  return true;
+}
+
+bool Benchmark::RunFused(int repeat) {
+  if (!RequireAtomicFloat("fused kernel comparison")) return true;
+  printf("[INFO] Compare two-kernel path and fused kernel with %d elements\n", elem_num_);
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  auto *sum_inputs = pipelines_->Get("sum_inputs"), *array_reduction = pipelines_->Get("array_reduction"),
+       *sum_inputs_reduction = pipelines_->Get("sum_inputs_reduction");
+  if (!sum_inputs || !array_reduction || !sum_inputs_reduction) return false;
+  double two_kernel_ms = 0, fused_ms = 0;
+  float sum = 0, fused_sum = 0;
+  for (int i = 0; i < repeat; i++) {
+    if (!buffers_["sum"].SetZero() || !buffers_["fused_sum"].SetZero()) {
+      printf("[FATAL] Failed to set data.\n");
+      return false;
+    }
+    CommandRecorder recorder;
+    recorder.Begin(cmd_buffer_);
+    timer_.Reset(cmd_buffer_);
+    recorder.PushConstants(*sum_inputs, Params{elem_num_});
+    timer_.Mark(cmd_buffer_, 0);
+    recorder.Dispatch(*sum_inputs, desc_sets_["sum_inputs"], GridSize("sum_inputs", elem_num_),
+      1, 1, {{&buffers_["inputs"], Access::eRead}, {&buffers_["array"], Access::eWrite}});
+    recorder.Dispatch(*array_reduction, desc_sets_["array_reduction"],
+      GridSize("array_reduction", elem_num_), 1, 1, {{&buffers_["array"], Access::eRead},
+      {&buffers_["sum"], Access::eReadWrite}});
+    timer_.Mark(cmd_buffer_, 1);
+    // NOTE: 两条路径之间没有数据依赖，需要执行依赖避免重叠影响计时
+    cmd_buffer_.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader,
+      {}, nullptr, nullptr, nullptr);
+    timer_.Mark(cmd_buffer_, 2);
+    recorder.Dispatch(*sum_inputs_reduction, desc_sets_["sum_inputs_reduction"],
+      GridSize("sum_inputs_reduction", elem_num_), 1, 1,
+      {{&buffers_["inputs"], Access::eRead}, {&buffers_["fused_sum"], Access::eReadWrite}});
+    timer_.Mark(cmd_buffer_, 3);
+    recorder.End();
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+    VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+    if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+    VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+    double ms;
+    if (!timer_.GetElapsed(0, 1, ms)) return false;
+    two_kernel_ms += ms;
+    if (!timer_.GetElapsed(2, 3, ms)) return false;
+    fused_ms += ms;
+  }
+  if (!buffers_["sum"].GetData(&sum, 1) || !buffers_["fused_sum"].GetData(&fused_sum, 1)) {
+    printf("[FATAL] Failed to get data from GPU\n");
+    return false;
+  }
+  two_kernel_ms /= repeat;
+  fused_ms /= repeat;
+  //! 两个kernel：读inputs + 写array + 读array；融合：只读inputs
+  double input_bytes = double(elem_num_) * sizeof(Input);
+  double saved_bytes = double(elem_num_) * sizeof(float) * 2;
+  double two_kernel_bytes = input_bytes + saved_bytes;
+  printf("[INFO] Two kernels: sum %f, %.3f ms, %.2f MB traffic, %.2f GB/s\n", sum, two_kernel_ms,
+    two_kernel_bytes / 1e6, two_kernel_bytes / two_kernel_ms * 1e-6);
+  printf("[INFO] Fused kernel: sum %f, %.3f ms, %.2f MB traffic, %.2f GB/s\n", fused_sum, fused_ms,
+    input_bytes / 1e6, input_bytes / fused_ms * 1e-6);
+  printf("[INFO] Fused kernel saves %.2f MB (%.1f%%) of traffic, speedup %.2fx\n", saved_bytes / 1e6,
+    saved_bytes / two_kernel_bytes * 100, two_kernel_ms / fused_ms);
+  return true;
+}
+
+bool Benchmark::RunLatency(int repeat, int small_elem_num) {
+  if (!RequireAtomicFloat("latency measurement")) return true;
+  printf("[INFO] Measure completion latency with %d elements for %d times\n", small_elem_num, repeat);
+  small_elem_num = min(small_elem_num, elem_num_);
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  auto *sum_inputs_reduction = pipelines_->Get("sum_inputs_reduction");
+  if (!sum_inputs_reduction) return false;
+  //! 只录制一次，重复提交
+  CommandRecorder recorder;
+  recorder.Begin(cmd_buffer_, false);
+  recorder.PushConstants(*sum_inputs_reduction, Params{small_elem_num});
+  recorder.Dispatch(*sum_inputs_reduction, desc_sets_["sum_inputs_reduction"],
+    GridSize("sum_inputs_reduction", small_elem_num), 1, 1,
+    {{&buffers_["inputs"], Access::eRead}, {&buffers_["fused_sum"], Access::eReadWrite}});
+  recorder.End();
+  vk::SubmitInfo submit_info;
+  submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+
+  const pair<WaitPolicy, const char *> policies[] = {
+    {WaitPolicy::eBlock, "block"}, {WaitPolicy::eSpin, "spin"}, {WaitPolicy::eHybrid, "hybrid"}};
+  vector<double> latencies(repeat);
+  for (auto &policy: policies) {
+    for (int i = 0; i < repeat; i++) {
+      auto start = chrono::steady_clock::now();
+      VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+      if (!WaitFence(vk_info_.device, fence_, policy.first, spin_us_)) return false;
+      latencies[i] = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+    }
+    sort(latencies.begin(), latencies.end());
+    printf("[INFO] Wait policy %-6s: p50 %.1f us, p99 %.1f us, max %.1f us\n", policy.second,
+      latencies[repeat / 2], latencies[min(repeat - 1, repeat * 99 / 100)], latencies.back());
+  }
+  return true;
+}
+
+/** 一个GPU job：提交后挂起，GPU完成后在完成线程上继续执行 */
+static DetachedTask AsyncReduce(GpuJobQueue &queue, vk::CommandBuffer cmd_buffer, vk::Fence fence,
+                                atomic<int> &num_done, atomic<int> &num_failed) {
+  auto res = co_await queue.Run(cmd_buffer, fence);
+  if (res != vk::Result::eSuccess)
+    num_failed++;
+  num_done++;
+  num_done.notify_one();
+}
+
+bool Benchmark::RunAsync(int num_jobs, int job_elem_num) {
+  if (!RequireAtomicFloat("async jobs")) return true;
+  printf("[INFO] Run %d async jobs with %d elements each\n", num_jobs, job_elem_num);
+  job_elem_num = min(job_elem_num, elem_num_);
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_) || !buffers_["fused_sum"].SetZero()) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  auto *sum_inputs_reduction = pipelines_->Get("sum_inputs_reduction");
+  if (!sum_inputs_reduction) return false;
+  //! 每个job一个command buffer和fence，处理inputs的不同区间，都累加到fused_sum上
+  vector<vk::CommandBuffer> cmd_buffers(num_jobs);
+  vector<vk::Fence> fences(num_jobs);
+  vk::CommandBufferAllocateInfo alloc_info(vk_info_.cmd_pool, vk::CommandBufferLevel::ePrimary, num_jobs);
+  VK_CHECK(vk_info_.device.allocateCommandBuffers(&alloc_info, cmd_buffers.data()));
+  for (int i = 0; i < num_jobs; i++) {
+    vk::FenceCreateInfo fence_info;
+    VK_CHECK(vk_info_.device.createFence(&fence_info, nullptr, &fences[i]));
+    CommandRecorder recorder;
+    recorder.Begin(cmd_buffers[i]);
+    Params params{job_elem_num, uint32_t(int64_t(i) * job_elem_num % (elem_num_ - job_elem_num + 1))};
+    recorder.PushConstants(*sum_inputs_reduction, params);
+    recorder.Dispatch(*sum_inputs_reduction, desc_sets_["sum_inputs_reduction"],
+      GridSize("sum_inputs_reduction", job_elem_num), 1, 1,
+      {{&buffers_["inputs"], Access::eRead}, {&buffers_["fused_sum"], Access::eReadWrite}});
+    recorder.End();
+  }
+  //! 发起所有job，当前线程不等待GPU
+  atomic<int> num_done = 0, num_failed = 0;
+  auto start = chrono::steady_clock::now();
+  {
+    GpuJobQueue job_queue(vk_info_);
+    for (int i = 0; i < num_jobs; i++)
+      AsyncReduce(job_queue, cmd_buffers[i], fences[i], num_done, num_failed);
+    auto submit_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("[INFO] All jobs submitted in %.3f ms\n", submit_ms);
+    for (int done = num_done.load(); done < num_jobs; done = num_done.load())
+      num_done.wait(done);
+  }
+  auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  for (auto &fence: fences)
+    vk_info_.device.destroyFence(fence);
+  vk_info_.device.freeCommandBuffers(vk_info_.cmd_pool, cmd_buffers);
+  float sum;
+  if (num_failed > 0 || !buffers_["fused_sum"].GetData(&sum, 1)) {
+    printf("[FATAL] %d async jobs failed\n", num_failed.load());
+    return false;
+  }
+  printf("[INFO] Sum of async jobs in GPU is %f, CPU is %f\n", sum, float(num_jobs) * job_elem_num * 3 * base_num);
+  printf("[INFO] %d jobs finished in %.3f ms, %.1f jobs/s\n", num_jobs, elapsed, num_jobs / elapsed * 1e3);
+  return true;
+}
+
+bool Benchmark::RunStreaming(int repeat, int slice_elem_num) {
+  if (!RequireAtomicFloat("streaming")) return true;
+  slice_elem_num = AlignSlice(slice_elem_num);
+  int num_slices = elem_num_ / slice_elem_num;
+  if (num_slices == 0) {
+    printf("[ERROR] Slice size %d is larger than the number of elements\n", slice_elem_num);
+    return false;
+  }
+  bool push_supported = vk_info_.push_descriptor_fn != nullptr;
+  printf("[INFO] Stream %d slices of %d elements per frame with %s\n", num_slices, slice_elem_num,
+    push_supported ? "push descriptors" : "a linear descriptor allocator");
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  auto &desc = desc_sets_["streaming"];
+  auto *pipeline = pipelines_->Get("streaming");
+  if (!pipeline) return false;
+  DescriptorAllocator frame_descs;
+  if (!push_supported && !frame_descs.Init(vk_info_))
+    return false;
+  double record_us = 0, gpu_ms = 0;
+  float sum = 0;
+  uint32_t grid = GridSize("sum_inputs_reduction", slice_elem_num);
+  for (int r = 0; r < repeat; r++) {
+    if (!buffers_["fused_sum"].SetZero()) return false;
+    auto start = chrono::steady_clock::now();
+    CommandRecorder recorder;
+    recorder.desc_allocator = push_supported ? nullptr : &frame_descs;
+    recorder.Begin(cmd_buffer_);
+    timer_.Reset(cmd_buffer_);
+    // NOTE: 每块都从绑定区间的开头开始，offset为0
+    recorder.PushConstants(*pipeline, Params{slice_elem_num});
+    timer_.Mark(cmd_buffer_, 0);
+    for (int i = 0; i < num_slices; i++) {
+      vk::DeviceSize slice_bytes = vk::DeviceSize(slice_elem_num) * sizeof(Input);
+      if (!recorder.DispatchPush(*pipeline, desc,
+            {{&buffers_["inputs"], Access::eRead, i * slice_bytes, slice_bytes},
+             {&buffers_["fused_sum"], Access::eReadWrite}}, grid, 1, 1))
+        return false;
+    }
+    timer_.Mark(cmd_buffer_, 1);
+    recorder.End();
+    record_us += chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeat;
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+    VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+    if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+    VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+    //! 帧结束，一次性回收这一帧分配的所有set
+    if (!push_supported && !frame_descs.Reset()) return false;
+    double elapsed;
+    if (!timer_.GetElapsed(0, 1, elapsed)) return false;
+    gpu_ms += elapsed / repeat;
+  }
+  if (!buffers_["fused_sum"].GetData(&sum, 1)) return false;
+  if (!push_supported)
+    frame_descs.PrintStats("Per-frame");
+  printf("[INFO] Sum of streaming in GPU is %f, CPU is %f\n", sum, float(num_slices) * slice_elem_num * 3 * base_num);
+  printf("[INFO] Streaming frame: record %.1f us (%.2f us per dispatch), GPU %.3f ms\n", record_us,
+    record_us / num_slices, gpu_ms);
+  return true;
+}
+
+bool Benchmark::RunBindless(int repeat, int slice_elem_num) {
+  if (!RequireAtomicFloat("bindless benchmark")) return true;
+  if (!vk_info_.bindless_supported) {
+    printf("[INFO] Descriptor indexing is not supported, skip bindless benchmark\n");
+    return true;
+  }
+  slice_elem_num = AlignSlice(slice_elem_num);
+  int num_slices = elem_num_ / slice_elem_num;
+  if (num_slices == 0) {
+    printf("[ERROR] Slice size %d is larger than the number of elements\n", slice_elem_num);
+    return false;
+  }
+  printf("[INFO] Stream %d slices of %d elements per frame with a bindless table\n", num_slices, slice_elem_num);
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  auto *pipeline = pipelines_->Get("bindless_reduction");
+  if (!pipeline) return false;
+  //! 每块只注册一次，之后每次dispatch只需要在push constant中传下标
+  vk::DeviceSize slice_bytes = vk::DeviceSize(slice_elem_num) * sizeof(Input);
+  vector<uint32_t> slice_idx(num_slices);
+  bool register_success = true;
+  for (int i = 0; i < num_slices; i++) {
+    slice_idx[i] = bindless_.Register(buffers_["inputs"], i * slice_bytes, slice_bytes);
+    register_success &= slice_idx[i] != UINT32_MAX;
+  }
+  auto unregister = [&]() {
+    for (auto idx: slice_idx)
+      if (idx != UINT32_MAX) bindless_.Unregister(idx);
+  };
+  if (!register_success) {
+    unregister();
+    return false;
+  }
+  double record_us = 0, gpu_ms = 0;
+  float sum = 0;
+  uint32_t grid = GridSize("sum_inputs_reduction", slice_elem_num);
+  uint32_t sum_idx = bindless_idx_["fused_sum"];
+  for (int r = 0; r < repeat; r++) {
+    if (!buffers_["fused_sum"].SetZero()) return false;
+    auto start = chrono::steady_clock::now();
+    CommandRecorder recorder;
+    recorder.Begin(cmd_buffer_);
+    timer_.Reset(cmd_buffer_);
+    timer_.Mark(cmd_buffer_, 0);
+    for (int i = 0; i < num_slices; i++) {
+      // NOTE: 只有第一次dispatch会绑定pipeline和set
+      recorder.PushConstants(*pipeline, BindlessParams{slice_elem_num, 0, slice_idx[i], sum_idx});
+      recorder.Dispatch(*pipeline, bindless_.desc, grid, 1, 1,
+        {{&buffers_["inputs"], Access::eRead, i * slice_bytes, slice_bytes},
+         {&buffers_["fused_sum"], Access::eReadWrite}});
+    }
+    timer_.Mark(cmd_buffer_, 1);
+    recorder.End();
+    record_us += chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeat;
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+    VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+    if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+    VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+    double elapsed;
+    if (!timer_.GetElapsed(0, 1, elapsed)) return false;
+    gpu_ms += elapsed / repeat;
+  }
+  unregister();
+  if (!buffers_["fused_sum"].GetData(&sum, 1)) return false;
+  printf("[INFO] Sum of bindless in GPU is %f, CPU is %f\n", sum, float(num_slices) * slice_elem_num * 3 * base_num);
+  printf("[INFO] Bindless frame: record %.1f us (%.2f us per dispatch), GPU %.3f ms\n", record_us,
+    record_us / num_slices, gpu_ms);
+  return true;
+}
+
+bool Benchmark::RequireAtomicFloat(const char *what) const {
+  if (vk_info_.atomic_float_supported) return true;
+  printf("[INFO] VK_EXT_shader_atomic_float is not supported, skip %s\n", what);
+  return false;
+}
+
+bool Benchmark::RecordTwoPassReduction(CommandRecorder &recorder, int num, const string &kernel) {
+  auto *pipeline = pipelines_->Get(kernel);
+  if (!pipeline) return false;
+  //! 第一遍每个workgroup写一个部分和，第二遍用一个workgroup按固定顺序规约所有部分和
+  uint32_t grid = GridSize(kernel, num);
+  recorder.PushConstants(*pipeline, Params{num});
+  recorder.Dispatch(*pipeline, desc_sets_[kernel], grid, 1, 1,
+    {{&buffers_["array"], Access::eRead}, {&buffers_["partials"], Access::eWrite}});
+  recorder.PushConstants(*pipeline, Params{int(grid)});
+  recorder.Dispatch(*pipeline, desc_sets_["array_reduction_two_pass_final"], 1, 1, 1,
+    {{&buffers_["partials"], Access::eRead}, {&buffers_["sum"], Access::eWrite}});
+  return true;
+}
+
+int Benchmark::AlignSlice(int slice_elem_num) const {
+  auto alignment = vk_info_.phy_device.getProperties().limits.minStorageBufferOffsetAlignment;
+  while (slice_elem_num * sizeof(Input) % alignment != 0)
+    slice_elem_num++;
+  return slice_elem_num;
+}
+
+bool Benchmark::MeasureDispatch(const Pipeline &pipeline, const DescriptorSet &desc, uint32_t grid, int repeat,
+                                double &ms) {
+  ms = 0;
+  for (int i = 0; i < repeat; i++) {
+    CommandRecorder recorder;
+    recorder.Begin(cmd_buffer_);
+    timer_.Reset(cmd_buffer_);
+    recorder.PushConstants(pipeline, Params{elem_num_});
+    timer_.Mark(cmd_buffer_, 0);
+    recorder.Dispatch(pipeline, desc, grid, 1, 1, {});
+    timer_.Mark(cmd_buffer_, 1);
+    recorder.End();
+    vk::SubmitInfo submit_info;
+    submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+    VK_CHECK(vk_info_.queue.submit(1, &submit_info, fence_));
+    if (!WaitFence(vk_info_.device, fence_, wait_policy_, spin_us_)) return false;
+    VK_CHECK(vk_info_.device.resetFences(1, &fence_));
+    double elapsed;
+    if (!timer_.GetElapsed(0, 1, elapsed)) return false;
+    ms += elapsed / repeat;
+  }
+  return true;
+}
+
+bool Benchmark::Autotune(int repeat) {
+  printf("[INFO] Autotune kernels with %d elements on device %s\n", elem_num_, tuning_db_.device_key.c_str());
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  vector<string> names = {"sum_inputs", "array_reduction_two_pass"};
+  if (vk_info_.atomic_float_supported)
+    names.insert(names.end(), {"array_reduction", "sum_inputs_reduction"});
+  if (subgroup_reduction_)
+    names.push_back("array_reduction_subgroup");
+  const uint32_t elems_per_thread[] = {1, 2, 4, 8, 16, 32, 64};
+  uint32_t max_size = MaxWorkgroupSize();
+  for (auto &name: names) {
+    TuneConfig best = {0, 0, 0};
+    // NOTE: 设备上限小于32时只试上限本身
+    for (uint32_t size = min(32u, max_size); size <= max_size; size *= 2) {
+      //! 每个block size编译一次，sum_inputs没有shared数组
+      SpecConstants spec = name == "sum_inputs" ? SpecConstants{size} : SpecConstants{size, size};
+      Pipeline pipeline;
+      if (!pipeline.Init(vk_info_, desc_sets_[name], Spv(name), pipeline_cache_.cache, spec,
+                         sizeof(Params)))
+        return false;
+      for (auto ept: elems_per_thread) {
+        uint64_t groups = (uint64_t(elem_num_) + size * ept - 1) / (size * ept);
+        double ms;
+        if (!MeasureDispatch(pipeline, desc_sets_[name], uint32_t(min<uint64_t>(groups, 65535)), repeat, ms))
+          return false;
+        if (best.workgroup_size == 0 || ms < best.ms)
+          best = {size, ept, ms};
+      }
+    }
+    if (best.workgroup_size == 0) {  // 没有测到任何配置时不保存，使用ChooseWorkgroupSize的默认值
+      printf("[WARNING] No config of %s was measured, use default workgroup size %u\n", name.c_str(),
+        workgroup_size_);
+      tuning_db_.configs.erase(name);
+      continue;
+    }
+    printf("[INFO] Best config of %-22s workgroup size %u, %u elements per thread, %.3f ms\n", name.c_str(),
+      best.workgroup_size, best.elems_per_thread, best.ms);
+    tuning_db_.configs[name] = best;
+  }
+  tuning_db_.Save();
+  //! 用调优后的配置重新编译
+  UpdateSpecs();
+  vk_info_.device.waitIdle();
+  for (auto &name: pipelines_->Names())
+    if (!pipelines_->Reload(name, Spv(ShaderName(name)), specs_[name]))
+      return false;
+  return true;
+}
+
+bool Benchmark::RunOptCompare(int repeat) {
+  vector<string> names = {"sum_inputs", "array_reduction_two_pass"};
+  if (vk_info_.atomic_float_supported)
+    names.insert(names.end(), {"array_reduction", "sum_inputs_reduction"});
+  if (Spv(names[0] + "_unopt").empty()) {
+    printf("[INFO] Shaders are built without spirv-opt, skip comparison\n");
+    return true;
+  }
+  printf("[INFO] Compare shaders with and without spirv-opt, %d elements for %d times\n", elem_num_, repeat);
+  float base_num = 1.f;
+  vector<Input> data(elem_num_, Input(base_num));
+  if (!buffers_["inputs"].SetData(data.data(), elem_num_)) {
+    printf("[FATAL] Failed to set data.\n");
+    return false;
+  }
+  for (auto &name: names) {
+    auto opt_code = Spv(name), unopt_code = Spv(name + "_unopt");
+    auto *opt = pipelines_->Get(name);
+    Pipeline unopt;
+    if (!opt || !unopt.Init(vk_info_, desc_sets_[name], unopt_code, pipeline_cache_.cache, specs_[name],
+                            sizeof(Params)))
+      return false;
+    double opt_ms, unopt_ms;
+    uint32_t grid = GridSize(name, elem_num_);
+    if (!MeasureDispatch(unopt, desc_sets_[name], grid, repeat, unopt_ms) ||
+        !MeasureDispatch(*opt, desc_sets_[name], grid, repeat, opt_ms))
+      return false;
+    printf("[INFO] %-22s unopt: %zu words %.3f ms, opt: %zu words %.3f ms, speedup %.2fx\n", name.c_str(),
+      unopt_code.size(), unopt_ms, opt_code.size(), opt_ms, unopt_ms / opt_ms);
+  }
+  return true;
+}
+
+#ifdef USE_SHADERC
+bool Benchmark::EnableHotReload(const string &shader_dir) {
+  shader_compiler_ = make_unique<ShaderCompiler>(shader_dir);
+  shader_watcher_ = make_unique<ShaderWatcher>(shader_dir);
+  //! 以源码为准，同时记录每个shader的依赖
+  vk_info_.device.waitIdle();
+  for (auto &name: pipelines_->Names()) {
+    vector<uint32_t> spv;
+    if (!shader_compiler_->Compile(ShaderName(name), spv) || !pipelines_->Reload(name, spv, specs_[name]))
+      return false;
+  }
+  printf("[INFO] Watching shaders in %s\n", shader_dir.c_str());
   return true;
 }
 
+int Benchmark::ReloadChangedShaders() {
+  auto changed = shader_watcher_->TakeChanged();
+  if (changed.empty()) return 0;
+  vk_info_.device.waitIdle();  // NOTE: 替换pipeline前GPU上不能有使用旧pipeline的命令
+  int num_reloaded = 0;
+  for (auto &name: pipelines_->Names()) {
+    if (!shader_compiler_->DependsOn(ShaderName(name), changed)) continue;
+    vector<uint32_t> spv;
+    if (shader_compiler_->Compile(ShaderName(name), spv) && pipelines_->Reload(name, spv, specs_[name]))
+      num_reloaded++;
+    else
+      printf("[ERROR] Failed to reload %s, keep using the old pipeline\n", name.c_str());
+  }
+  return num_reloaded;
+}
+#endif
+
+bool Benchmark::RunMultiDevice(int elem_num, int repeat) {
+  MultiDeviceReduction reduction(elem_num, Spv("array_reduction"));
+  if (!reduction.CreateSuccess()) {
+    printf("[FATAL] Create multi-device reduction failed!\n");
+    return false;
+  }
+  return reduction.Run(repeat);
+}
+
 /**
  * @brief 检查物理设备是否支持所需的所有扩展
  * @param[in] physical_device 物理设备
@@ -351,53 +1716,40 @@ int check_device_extension(const vk::PhysicalDevice &physical_device, const vect
   return -1;
 }
 
-bool Benchmark::InitVkInfo() {
-  auto &instance = vk_info_.instance;
-  auto api_version = VK_API_VERSION_1_3;
-  {//! 初始化instance
-    vk::ApplicationInfo app_info;
-    app_info.setPApplicationName("VulkanBenchmark");
-    app_info.setApiVersion(api_version);
-    app_info.setApplicationVersion(1);
+static const auto kApiVersion = VK_API_VERSION_1_3;
+static const vector<const char *> kDeviceExtensions = {"VK_KHR_shader_non_semantic_info"};
+static const vector<const char *> kOptionalDeviceExtensions = {"VK_EXT_shader_atomic_float",  // 不支持时使用替代方案
+                                                               "VK_KHR_push_descriptor"};
 
-    const vector<const char *> layer_names = {"VK_LAYER_KHRONOS_validation"};
-    vk::InstanceCreateInfo create_info({}, &app_info, layer_names, {});
-    VK_CHECK(vk::createInstance(&create_info, nullptr, &instance));
-  }
+bool CreateInstance(vk::Instance &instance) {
+  vk::ApplicationInfo app_info;
+  app_info.setPApplicationName("VulkanBenchmark");
+  app_info.setApiVersion(kApiVersion);
+  app_info.setApplicationVersion(1);
 
-  auto &phy_device = vk_info_.phy_device;
-  const vector<const char *> extension_names = {"VK_EXT_shader_atomic_float", "VK_KHR_shader_non_semantic_info"};
-  {//! 初始化physical device
-    vector<vk::PhysicalDevice> phy_devices = instance.enumeratePhysicalDevices();
-    if (phy_devices.empty()) {
-      cout << "[FATAL] No physical device found!" << endl;
-      return false;
-    }
-    for(int i = 0; i<phy_devices.size(); i++) {
-      const auto &device = phy_devices[i];
-      vk::PhysicalDeviceProperties prop = device.getProperties();
-      cout << "[INFO] Found " << i << "th physical device name: " << prop.deviceName
-            << ", type: " << vk::to_string(prop.deviceType) << ", ";
-      int not_support_id = check_device_extension(device, extension_names);
-      if (not_support_id >= 0) {
-        cout << "not support extension: " << extension_names[not_support_id] << endl;
-        return false;
-      };
-      cout << endl;
-    }
+  const vector<const char *> layer_names = {"VK_LAYER_KHRONOS_validation"};
+  vk::InstanceCreateInfo create_info({}, &app_info, layer_names, {});
+  VK_CHECK(vk::createInstance(&create_info, nullptr, &instance));
+  return true;
+}
 
-    int device_id = 0;
-    cout << "Please input the device id you want to use: " << endl;
-    cin >> device_id;
-    if(device_id > phy_devices.size() - 1 || device_id < 0) {
-      cout << "[ERROR] invalid device id " << device_id << ", use the first device by default" << endl;
-      device_id = 0;
-    }
-    phy_device = phy_devices[device_id];
-  }
+int CheckDeviceSuitable(const vk::PhysicalDevice &phy_device) {
+  return check_device_extension(phy_device, kDeviceExtensions);
+}
+
+bool SupportsAtomicFloat(const vk::PhysicalDevice &phy_device) {
+  if (check_device_extension(phy_device, {"VK_EXT_shader_atomic_float"}) >= 0)
+    return false;
+  auto features = phy_device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                          vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>();
+  return features.get<vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT>().shaderBufferFloat32AtomicAdd;
+}
 
-  auto &device = vk_info_.device;
-  auto &queue_idx = vk_info_.queue_idx;
+bool InitDevice(VkInfo &info, vk::Instance instance, vk::PhysicalDevice phy_device) {
+  info.instance = instance;
+  info.phy_device = phy_device;
+  auto &device = info.device;
+  auto &queue_idx = info.queue_idx;
   { //! 初始化device
     vector<vk::QueueFamilyProperties> queue_props = phy_device.getQueueFamilyProperties();
     queue_idx = UINT32_MAX;
@@ -416,82 +1768,269 @@ bool Benchmark::InitVkInfo() {
     float priority = 1.0f;
     vk::DeviceQueueCreateInfo queue_info({}, queue_idx, 1, &priority);
 
+    //! float原子加是可选的，不支持时用两遍规约
+    info.atomic_float_supported = SupportsAtomicFloat(phy_device);
     vk::PhysicalDeviceShaderAtomicFloatFeaturesEXT atomic_float_feat; // TODO: 这是啥？
     // atomic_float_feat.shaderBufferFloat32Atomics = vk::True;
     // atomic_float_feat.shaderSharedFloat32Atomics = vk::True;
-    atomic_float_feat.shaderBufferFloat32AtomicAdd = vk::True;
-    atomic_float_feat.shaderSharedFloat32AtomicAdd = vk::True;
+    atomic_float_feat.shaderBufferFloat32AtomicAdd = vk::True;  // NOTE: shader中只用到storage buffer上的原子加
     // NOTE: PhysicalDeviceShaderAtomicFloat2FeaturesEXT里支持半精度和双进度的float以及max和min
 
+    //! bindless表需要的descriptor indexing特性，不支持时不使用BindlessTable
+    auto features = phy_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+    auto &supported12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+    vk::PhysicalDeviceVulkan12Features features12;
+    features12.runtimeDescriptorArray = supported12.runtimeDescriptorArray;
+    features12.descriptorBindingPartiallyBound = supported12.descriptorBindingPartiallyBound;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = supported12.descriptorBindingStorageBufferUpdateAfterBind;
+    info.bindless_supported = features12.runtimeDescriptorArray && features12.descriptorBindingPartiallyBound &&
+                              features12.descriptorBindingStorageBufferUpdateAfterBind;
+    atomic_float_feat.setPNext(&features12);
+    void *features_chain = info.atomic_float_supported ? static_cast<void *>(&atomic_float_feat) : &features12;
+
     vk::DeviceCreateInfo create_info;
     create_info.setQueueCreateInfos({queue_info});
     create_info.setPEnabledLayerNames({});
-    create_info.setPEnabledExtensionNames(extension_names);
-    create_info.setPNext(&atomic_float_feat);  // 链接到特性结构
+    auto extensions = kDeviceExtensions;
+    for (auto &ext: kOptionalDeviceExtensions)
+      if (check_device_extension(phy_device, {ext}) < 0)
+        extensions.push_back(ext);
+    create_info.setPEnabledExtensionNames(extensions);
+    create_info.setPNext(features_chain);  // 链接到特性结构
     VK_CHECK(phy_device.createDevice(&create_info, nullptr, &device));
   }
+  //! 扩展函数不在loader导出的符号中，需要从device获取
+  if (check_device_extension(phy_device, {"VK_KHR_push_descriptor"}) < 0)
+    info.push_descriptor_fn = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+      device.getProcAddr("vkCmdPushDescriptorSetKHR"));
+  info.layout_cache = new LayoutCache;
+  info.layout_cache->device = device;
   { //! 初始化command pool
-    vk::CommandPoolCreateInfo create_info({}, queue_idx);
-    VK_CHECK(device.createCommandPool(&create_info, nullptr, &vk_info_.cmd_pool));
+    // NOTE: command buffer需要重复录制
+    vk::CommandPoolCreateInfo create_info(vk::CommandPoolCreateFlagBits::eResetCommandBuffer, queue_idx);
+    VK_CHECK(device.createCommandPool(&create_info, nullptr, &info.cmd_pool));
   }
   { //! 获取queue
-    vk_info_.queue = device.getQueue(queue_idx, 0);
-  }
-  { //! 初始化descriptor pool
-    vector<vk::DescriptorPoolSize> pool_sizes = {
-      {vk::DescriptorType::eStorageBuffer, 10},
-      {vk::DescriptorType::eUniformBuffer, 10}
-    };
-    vk::DescriptorPoolCreateInfo create_info;
-    create_info.setMaxSets(10);             // 可以分配的descriptor set的最大数量
-    create_info.setPoolSizes(pool_sizes);
-    create_info.setFlags(vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet);
-    VK_CHECK(device.createDescriptorPool(&create_info, nullptr, &vk_info_.desc_pool));
+    info.queue = device.getQueue(queue_idx, 0);
+  }
+  { //! 初始化descriptor分配器，pool不够时自动增加
+    info.desc_allocator = new DescriptorAllocator;
+    if (!info.desc_allocator->Init(info))
+      return false;
   }
 #ifdef USE_VMA
   { //! 初始化VmaAllocator
     VmaAllocatorCreateInfo create_info = {};
-    create_info.vulkanApiVersion = api_version;
+    create_info.vulkanApiVersion = kApiVersion;
     create_info.physicalDevice = phy_device;
     create_info.device = device;
     create_info.instance = instance;
-    VK_CHECK(vmaCreateAllocator(&create_info, &vk_info_.allocator));
+    VK_CHECK(vmaCreateAllocator(&create_info, &info.allocator));
   }
 #else
-  vk_info_.mem_props = phy_device.getMemoryProperties();
+  info.mem_props = phy_device.getMemoryProperties();
 #endif
   return true;
 }
 
+bool Benchmark::InitVkInfo() {
+  vk::Instance instance;
+  if (!CreateInstance(instance))  //! 初始化instance
+    return false;
+
+  vk::PhysicalDevice phy_device;
+  {//! 初始化physical device
+    vector<vk::PhysicalDevice> phy_devices = instance.enumeratePhysicalDevices();
+    if (phy_devices.empty()) {
+      cout << "[FATAL] No physical device found!" << endl;
+      return false;
+    }
+    for(int i = 0; i<phy_devices.size(); i++) {
+      const auto &device = phy_devices[i];
+      vk::PhysicalDeviceProperties prop = device.getProperties();
+      cout << "[INFO] Found " << i << "th physical device name: " << prop.deviceName
+            << ", type: " << vk::to_string(prop.deviceType) << ", ";
+      int not_support_id = CheckDeviceSuitable(device);
+      if (not_support_id >= 0) {
+        cout << "not support extension: " << kDeviceExtensions[not_support_id] << endl;
+        return false;
+      };
+      cout << endl;
+    }
+
+    int device_id = 0;
+    cout << "Please input the device id you want to use: " << endl;
+    cin >> device_id;
+    if(device_id > phy_devices.size() - 1 || device_id < 0) {
+      cout << "[ERROR] invalid device id " << device_id << ", use the first device by default" << endl;
+      device_id = 0;
+    }
+    phy_device = phy_devices[device_id];
+  }
+  return InitDevice(vk_info_, instance, phy_device);
+}
+
 bool Benchmark::CreateBuffers() {
   bool create_success = true;
   create_success &= buffers_["inputs"].Init(vk_info_, sizeof(Input), elem_num_, vk::BufferUsageFlagBits::eStorageBuffer,
       MEMORY_CPU_TO_GPU);
   create_success &= buffers_["array"].Init(vk_info_, sizeof(float), elem_num_, vk::BufferUsageFlagBits::eStorageBuffer,
       MEMORY_GPU_ONLY);
-  create_success &= buffers_["num"].Init(vk_info_, sizeof(int), 1, vk::BufferUsageFlagBits::eUniformBuffer,
-      MEMORY_CPU_TO_GPU);
   create_success &= buffers_["sum"].Init(vk_info_, sizeof(float), 1, vk::BufferUsageFlagBits::eStorageBuffer,
       MEMORY_GPU_TO_CPU);
+  // NOTE: 两遍规约每个workgroup一个部分和，65535是grid size上限的最小保证值
+  create_success &= buffers_["partials"].Init(vk_info_, sizeof(float), 65535, vk::BufferUsageFlagBits::eStorageBuffer,
+      MEMORY_GPU_ONLY);
+  create_success &= buffers_["fused_sum"].Init(vk_info_, sizeof(float), 1, vk::BufferUsageFlagBits::eStorageBuffer,
+      MEMORY_GPU_TO_CPU);
+  create_success &= buffers_["dispatch_args"].Init(vk_info_, sizeof(vk::DispatchIndirectCommand), 1,
+      vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer, MEMORY_GPU_ONLY);
   return create_success;
 }
 
 bool Benchmark::CreateDescriptors() {
   bool create_success = true;
-  create_success &= desc_sets_["sum_inputs"].Init(vk_info_, {&buffers_["inputs"], &buffers_["array"],
-    &buffers_["num"]});
-  create_success &= desc_sets_["array_reduction"].Init(vk_info_, {&buffers_["array"], &buffers_["sum"],
-    &buffers_["num"]});
+  create_success &= desc_sets_["sum_inputs"].Init(vk_info_, {&buffers_["inputs"], &buffers_["array"]});
+  create_success &= desc_sets_["array_reduction"].Init(vk_info_, {&buffers_["array"], &buffers_["sum"]});
+  create_success &= desc_sets_["array_reduction_subgroup"].Init(vk_info_, {&buffers_["array"], &buffers_["sum"]});
+  create_success &= desc_sets_["array_reduction_two_pass"].Init(vk_info_, {&buffers_["array"], &buffers_["partials"]});
+  create_success &= desc_sets_["array_reduction_kahan"].Init(vk_info_, {&buffers_["array"], &buffers_["partials"]});
+  create_success &= desc_sets_["array_reduction_two_pass_final"].Init(vk_info_,
+    {&buffers_["partials"], &buffers_["sum"]});
+  create_success &= desc_sets_["sum_inputs_reduction"].Init(vk_info_, {&buffers_["inputs"], &buffers_["fused_sum"]});
+  create_success &= desc_sets_["dispatch_args"].Init(vk_info_, {&buffers_["dispatch_args"]});
+  create_success &= desc_sets_["streaming"].Init(vk_info_, {&buffers_["inputs"], &buffers_["fused_sum"]}, true);
+  vk_info_.desc_allocator->PrintStats("Persistent");
+  if (vk_info_.bindless_supported && create_success) {
+    //! 所有bindless kernel共用的表，buffer只注册一次
+    if (!bindless_.Init(vk_info_))
+      return false;
+    for (auto name: {"inputs", "fused_sum"}) {
+      bindless_idx_[name] = bindless_.Register(buffers_[name]);
+      create_success &= bindless_idx_[name] != UINT32_MAX;
+    }
+  }
   return create_success;
 }
 
 bool Benchmark::CreatePipelines() {
+  vector<string> names = {"sum_inputs", "dispatch_args", "array_reduction_two_pass", "array_reduction_kahan"};
+  //! 用到float原子加的kernel只在设备支持时创建
+  if (vk_info_.atomic_float_supported)
+    names.insert(names.end(), {"array_reduction", "sum_inputs_reduction", "streaming"});
+  if (vk_info_.atomic_float_supported && vk_info_.bindless_supported)
+    names.push_back("bindless_reduction");
+  //! compute shader支持subgroup arithmetic时用subgroupAdd规约
+  auto props = vk_info_.phy_device.getProperties2<vk::PhysicalDeviceProperties2,
+                                                  vk::PhysicalDeviceSubgroupProperties>();
+  auto &subgroup = props.get<vk::PhysicalDeviceSubgroupProperties>();
+  subgroup_reduction_ = vk_info_.atomic_float_supported &&
+                        (subgroup.supportedOperations & vk::SubgroupFeatureFlagBits::eArithmetic) &&
+                        (subgroup.supportedStages & vk::ShaderStageFlagBits::eCompute);
+  printf("[INFO] Subgroup size %u, reduce with %s\n", subgroup.subgroupSize, !vk_info_.atomic_float_supported ?
+    "two passes" : subgroup_reduction_ ? "subgroupAdd" : "shared memory tree");
+  if (subgroup_reduction_)
+    names.push_back("array_reduction_subgroup");
+  uint64_t shader_hash = HashShaderCode({});
+  for (auto &name: names)
+    shader_hash = HashShaderCode(Spv(ShaderName(name)), shader_hash);
+  if (!pipeline_cache_.Init(vk_info_, ".", shader_hash))
+    return false;
+  //! 每个设备用自己合适的block size特化同一个SPIR-V
+  workgroup_size_ = ChooseWorkgroupSize();
+  printf("[INFO] Workgroup size: %u\n", workgroup_size_);
+  tuning_db_.Load("autotune.db", vk_info_.phy_device);  // 有调优结果时覆盖默认的block size
+  UpdateSpecs();
+  pipelines_->Init(vk_info_, pipeline_cache_.cache);
+  for (auto &name: names) {
+    if (name == "bindless_reduction")
+      pipelines_->Register(name, bindless_.desc, Spv(name), specs_[name], sizeof(BindlessParams));
+    else
+      pipelines_->Register(name, desc_sets_[name], Spv(ShaderName(name)), specs_[name], sizeof(Params));
+  }
+  if (lazy_) {
+    //! 第一次使用时才编译，后台线程按Run中的使用顺序提前编译
+    pipelines_->Warmup({"dispatch_args", "sum_inputs", "array_reduction", "array_reduction_two_pass",
+                        "sum_inputs_reduction"});
+    return true;
+  }
+  //! 多线程并行编译所有pipeline
+  uint32_t num_threads = min<uint32_t>(max(thread::hardware_concurrency(), 1u), uint32_t(names.size()));
+  auto start = chrono::steady_clock::now();
+  pipelines_->Warmup(names, num_threads);
+  pipelines_->WaitWarmup();
+  auto total_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
   bool create_success = true;
-  for (string name : {"sum_inputs", "array_reduction"})
-    create_success &= pipelines_[name].Init(vk_info_, desc_sets_[name], shader::comp_spv[name]);
+  for (auto &name: names)
+    create_success &= pipelines_->Get(name) != nullptr;
+  printf("[INFO] %zu pipelines created in %.3f ms with %u threads (%.3f ms in total)\n", names.size(), total_ms,
+    num_threads, pipelines_->TotalCompileMs());
+  printf("[INFO] %zu descriptor set layouts and %zu pipeline layouts created, %d reused\n",
+    vk_info_.layout_cache->set_layouts.size(), vk_info_.layout_cache->pipeline_layouts.size(),
+    vk_info_.layout_cache->num_reused);
+  if (create_success)
+    pipeline_cache_.Save();  // 下次启动时可以跳过编译
   return create_success;
 }
 
+uint32_t Benchmark::MaxWorkgroupSize() {
+  auto &limits = vk_info_.phy_device.getProperties().limits;
+  uint32_t max_size = min({limits.maxComputeWorkGroupSize[0], limits.maxComputeWorkGroupInvocations,
+                           limits.maxComputeSharedMemorySize / uint32_t(sizeof(float)), 1024u});
+  uint32_t size = 1;
+  while (size * 2 <= max_size)
+    size *= 2;
+  return size;
+}
+
+uint32_t Benchmark::ChooseWorkgroupSize() {
+  auto props = vk_info_.phy_device.getProperties2<vk::PhysicalDeviceProperties2,
+                                                  vk::PhysicalDeviceSubgroupProperties>();
+  uint32_t subgroup_size = props.get<vk::PhysicalDeviceSubgroupProperties>().subgroupSize;
+  uint32_t max_size = MaxWorkgroupSize();
+  //! 每个workgroup放4个subgroup
+  uint32_t size = 1;
+  while (size * 2 <= max_size && size < subgroup_size * 4)
+    size *= 2;
+  return size;
+}
+
+const char *Benchmark::ReductionKernel() const {
+  return subgroup_reduction_ ? "array_reduction_subgroup" : "array_reduction";
+}
+
+void Benchmark::UpdateSpecs() {
+  auto size = [&](const string &name) {
+    auto config = tuning_db_.Get(name);
+    return config ? config->workgroup_size : workgroup_size_;
+  };
+  const char *reduction = ReductionKernel();
+  auto config = tuning_db_.Get(reduction);
+  specs_ = {
+    {"sum_inputs", {size("sum_inputs")}},
+    {"array_reduction", {size("array_reduction"), size("array_reduction")}},
+    {"array_reduction_subgroup", {size("array_reduction_subgroup"), size("array_reduction_subgroup")}},
+    {"array_reduction_two_pass", {size("array_reduction_two_pass"), size("array_reduction_two_pass")}},
+    {"array_reduction_kahan", {size("array_reduction_kahan"), size("array_reduction_kahan")}},
+    {"sum_inputs_reduction", {size("sum_inputs_reduction"), size("sum_inputs_reduction")}},
+    {"bindless_reduction", {size("sum_inputs_reduction"), size("sum_inputs_reduction")}},
+    {"streaming", {size("sum_inputs_reduction"), size("sum_inputs_reduction")}},
+    // 特化常量2、3是Run中间接dispatch的规约kernel的block size和每个线程处理的元素数
+    {"dispatch_args", {1, 1, size(reduction), config ? config->elems_per_thread : 0}},
+  };
+}
+
+uint32_t Benchmark::GridSize(const string &name, int num) const {
+  auto spec = specs_.find(name);
+  uint32_t local_size = spec != specs_.end() && !spec->second.empty() ? spec->second[0] : workgroup_size_;
+  uint64_t n = uint64_t(max(num, 1));
+  if (auto config = tuning_db_.Get(name)) {
+    uint64_t per_group = uint64_t(local_size) * config->elems_per_thread;
+    return uint32_t(min<uint64_t>((n + per_group - 1) / per_group, 65535));  // NOTE: 65535是grid size上限的最小保证值
+  }
+  return min(uint32_t((n + local_size - 1) / local_size), max_groups_);
+}
+
 bool Benchmark::AllocateCommandBuffer() {
   vk::CommandBufferAllocateInfo info;
   info.setCommandPool(vk_info_.cmd_pool);
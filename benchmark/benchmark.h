@@ -3,10 +3,22 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <span>
 #ifdef USE_VMA
 #include "vk_mem_alloc.h" // Vulkan Memory Allocator library
 #endif
 
+# define VK_CHECK(call) \
+{ \
+  auto res = vk::Result(call); \
+  if (vk::Result::eSuccess != res) { \
+    printf("[Error] vulkan call failed in %s:%d, result is %s\n",__FILE__,__LINE__, vk::to_string(res).c_str()); \
+    return false; \
+  } \
+}
+
 // NOTE: https://gpuopen-librariesandsdks.github.io/VulkanMemoryAllocator/html/group__group__alloc.html#gaa5846affa1e9da3800e3e78fae2305cc
 #define MEMORY_GPU_ONLY VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
 #define MEMORY_CPU_ONLY VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
@@ -17,6 +29,9 @@
 // #define MEMORY_CPU_TO_GPU vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eDeviceLocal
 // #define MEMORY_GPU_TO_CPU vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCached
 
+struct LayoutCache;
+struct DescriptorAllocator;
+
 struct VkInfo {
   void Destroy();
   // ~VkInfo() { Destroy(); }
@@ -26,21 +41,38 @@ struct VkInfo {
   uint32_t queue_idx;
   vk::Queue queue;
   vk::CommandPool cmd_pool;
-  vk::DescriptorPool desc_pool;
+  DescriptorAllocator *desc_allocator = nullptr;  // 长期存在的descriptor set从这里分配，由InitDevice创建
 #ifdef USE_VMA
   VmaAllocator allocator;
 #else
   vk::PhysicalDeviceMemoryProperties mem_props;
 #endif
+  bool owns_instance = true;  // 多个设备共用一个instance时，只由创建者销毁
+  PFN_vkCmdPushDescriptorSetKHR push_descriptor_fn = nullptr;  // 设备不支持VK_KHR_push_descriptor时为空
+  bool bindless_supported = false;  // 是否支持BindlessTable需要的descriptor indexing特性
+  bool atomic_float_supported = false;  // 是否支持storage buffer上的float原子加，不支持时用两遍规约
+  LayoutCache *layout_cache = nullptr;  // 由InitDevice创建，Destroy时销毁
 };
 
+/** 创建带validation layer的instance */
+bool CreateInstance(vk::Instance &instance);
+/** 检查物理设备是否支持benchmark需要的扩展，返回第一个不支持的扩展id，<0表示都支持 */
+int CheckDeviceSuitable(const vk::PhysicalDevice &phy_device);
+/** 是否支持VK_EXT_shader_atomic_float的storage buffer float原子加 */
+bool SupportsAtomicFloat(const vk::PhysicalDevice &phy_device);
+/** 在phy_device上创建device、queue、command pool、descriptor pool等 */
+bool InitDevice(VkInfo &info, vk::Instance instance, vk::PhysicalDevice phy_device);
+
 struct Buffer {
   bool Init(const VkInfo &info, size_t elem_size, size_t num, vk::BufferUsageFlags buff_usage,
     int alloc_usage);
+  /** 创建和backing共用同一块内存的buffer，两者的生命周期不能重叠。不持有内存 */
+  bool InitAliased(const VkInfo &info, const Buffer &backing, size_t elem_size, size_t num,
+    vk::BufferUsageFlags buff_usage);
   void Destroy();
   /** 设置数据 */
   template<typename T>
-  bool SetData(T *data, size_t num);  // TODO: 只有CPU VISIABLE的才能set和get
+  bool SetData(T *data, size_t num);  // num可以小于num_elems，只写前num个。TODO: 只有CPU VISIABLE的才能set和get
   /** 数据初始化为0 */
   bool SetZero();
   /** 获取数据 */
@@ -53,6 +85,7 @@ struct Buffer {
   size_t num_elems;
   size_t size;
   vk::BufferUsageFlags usage;
+  bool owns_memory = true;  // 为false时内存属于别的buffer（aliasing）
 
 #ifdef USE_VMA
   VmaAllocation allocation; // Vulkan Memory Allocator allocation
@@ -61,27 +94,286 @@ struct Buffer {
   vk::Device device;
   vk::DeviceMemory mem;
   vk::MemoryRequirements mem_req; // 记录对齐后的内存大小
+  uint32_t mem_type_idx;
 #endif
 };
 
 struct DescriptorSet {
-  bool Init(const VkInfo &info, const std::vector<Buffer*> &buffers);
+  /**
+   * push_mode为true时不分配set，只创建layout，每次dispatch时用CommandRecorder::DispatchPush绑定buffer
+   * 设备支持push descriptor时直接写进command buffer，否则从recorder的desc_allocator分配
+   */
+  bool Init(const VkInfo &info, const std::vector<Buffer*> &buffers, bool push_mode = false);
+  /** 指向新的buffer，binding的类型和数量要和Init时一致 */
+  void Update(const std::vector<Buffer*> &buffers);
+  /**
+   * 用update template一次写入所有binding，infos[i]对应binding i，可以只指向buffer的一部分
+   * 不分配内存，适合每次迭代都要换buffer的情况
+   */
+  void Update(std::span<const vk::DescriptorBufferInfo> infos);
   void Destroy();
   ~DescriptorSet() { Destroy(); }
   vk::DescriptorSet set;
-  vk::DescriptorSetLayout layout;
+  vk::DescriptorSetLayout layout;  // 由LayoutCache持有
+  vk::DescriptorUpdateTemplate update_template;  // 由LayoutCache持有
+  std::vector<vk::DescriptorBufferInfo> buffer_infos;  // Update(buffers)时复用，避免每次分配
+  std::vector<vk::DescriptorType> types;  // 每个binding的类型
+  PFN_vkCmdPushDescriptorSetKHR push_fn = nullptr;  // 非空时layout是push descriptor layout
+  bool push = false;
+  vk::Device device;
+};
+
+/**
+ * 可增长的descriptor分配器：当前pool用完时链接一个新pool，不会因为pool大小固定而分配失败
+ * 新pool的set数量翻倍，每种descriptor的数量按已分配的set中的平均需求计算
+ * 不单独释放set，用Reset一次性回收所有pool，适合每帧重置
+ */
+struct DescriptorAllocator {
+  bool Init(const VkInfo &info, uint32_t initial_sets = 16);
+  /** types为layout中每个binding的类型，用于统计需求 */
+  bool Allocate(vk::DescriptorSetLayout layout, const std::vector<vk::DescriptorType> &types, vk::DescriptorSet &set);
+  /** 回收所有已分配的set，pool保留下来复用。调用前要保证GPU上没有使用它们的命令 */
+  bool Reset();
+  void Destroy();
+  ~DescriptorAllocator() { Destroy(); }
+  /** 打印pool数量、容量、使用率和各类型descriptor的需求 */
+  void PrintStats(const char *name) const;
+
+  struct Pool {
+    vk::DescriptorPool pool;
+    uint32_t max_sets;
+  };
+  vk::Device device;
+  std::mutex alloc_mutex;
+  std::vector<Pool> used_pools;   // 已经分配过set的pool，最后一个是当前pool
+  std::vector<Pool> free_pools;   // Reset后可以复用的pool
+  uint32_t next_sets;             // 下一个新pool的set数量
+  uint32_t num_pools = 0;         // 创建过的pool数量
+  uint32_t num_allocated = 0;     // 上次Reset之后分配的set数量
+  uint64_t total_allocated = 0;   // 一共分配过的set数量
+  uint32_t num_resets = 0;
+  std::unordered_map<vk::DescriptorType, uint64_t> demand;  // 每种类型一共分配过的descriptor数量
+
+private:
+  /** 取一个可复用的pool，没有时按需求创建新的，min_counts是当前set需要的数量。created表示是否新建 */
+  bool NextPool(const std::unordered_map<vk::DescriptorType, uint32_t> &min_counts, bool &created);
+};
+
+/**
+ * 全局的bindless storage buffer表（descriptor indexing，Vulkan 1.2核心）：binding 0是storage buffer数组
+ * buffer只需注册一次，kernel通过push constant中的下标访问，所有dispatch共用同一个descriptor set
+ */
+struct BindlessTable {
+  /** max_buffers会被限制在设备支持的范围内 */
+  bool Init(const VkInfo &info, uint32_t max_buffers = 1024);
+  /**
+   * 把buffer的[offset, offset+size)放进表中，返回下标，表满时返回UINT32_MAX
+   * NOTE: set用UPDATE_AFTER_BIND创建，可以在GPU使用这个set时注册其他下标
+   */
+  uint32_t Register(const Buffer &buffer, vk::DeviceSize offset = 0, vk::DeviceSize size = VK_WHOLE_SIZE);
+  /** 释放下标以便复用，调用前要保证GPU不再通过这个下标访问 */
+  void Unregister(uint32_t idx);
+  void Destroy();
+  ~BindlessTable() { Destroy(); }
+  DescriptorSet desc;  // 可以直接用于Pipeline::Init和CommandRecorder::Dispatch
+  vk::DescriptorPool pool;  // NOTE: UPDATE_AFTER_BIND的set需要带对应flag的pool
   vk::Device device;
+  uint32_t capacity = 0;
+  uint32_t num_used = 0;  // 分配过的最大下标+1
+  std::vector<uint32_t> free_slots;  // Unregister后可以复用的下标
+  std::mutex table_mutex;
+};
+
+/** FNV-1a hash，用于区分shader的版本 */
+uint64_t HashShaderCode(std::span<const uint32_t> code, uint64_t seed = 14695981039346656037ull);
+
+/**
+ * 按签名去重的descriptor set layout和pipeline layout，相同binding的descriptor set和pipeline共用同一个layout
+ * 线程安全。layout由cache持有，在VkInfo::Destroy时统一销毁
+ */
+struct LayoutCache {
+  bool GetSetLayout(const std::vector<vk::DescriptorSetLayoutBinding> &bindings, vk::DescriptorSetLayout &layout,
+    vk::DescriptorSetLayoutCreateFlags flags = {});
+  /** push_constant_size为0时不使用push constant */
+  bool GetPipelineLayout(vk::DescriptorSetLayout set_layout, uint32_t push_constant_size, vk::PipelineLayout &layout);
+  /** 从连续的vk::DescriptorBufferInfo数组更新set的update template，第i个元素对应第i个binding */
+  bool GetUpdateTemplate(vk::DescriptorSetLayout set_layout, const std::vector<vk::DescriptorSetLayoutBinding> &bindings,
+    vk::DescriptorUpdateTemplate &update_template);
+  void Destroy();
+
+  struct KeyHash {
+    size_t operator()(const std::vector<uint32_t> &key) const { return HashShaderCode(key); }
+  };
+  vk::Device device;
+  std::mutex layout_mutex;
+  std::unordered_map<std::vector<uint32_t>, vk::DescriptorSetLayout, KeyHash> set_layouts;
+  std::unordered_map<std::vector<uint32_t>, vk::PipelineLayout, KeyHash> pipeline_layouts;
+  std::unordered_map<VkDescriptorSetLayout, vk::DescriptorUpdateTemplate> update_templates;
+  int num_reused = 0;  // 命中cache、没有创建新layout的次数
+};
+
+/**
+ * 所有pipeline共用的pipeline cache，保存在磁盘上，重启后可以跳过shader编译
+ * 文件名包含设备UUID、驱动版本和shader hash；加载时校验cache header，不匹配或损坏时使用空cache
+ */
+struct PipelineCache {
+  bool Init(const VkInfo &info, const std::string &dir, uint64_t shader_hash);
+  /** 先写临时文件再rename，保证磁盘上的cache文件总是完整的 */
+  bool Save();
+  void Destroy();
+  ~PipelineCache() { Destroy(); }
+  vk::PipelineCache cache;
+  vk::Device device;
+  std::string path;
+};
+
+/** 调优得到的kernel配置 */
+struct TuneConfig {
+  uint32_t workgroup_size;
+  uint32_t elems_per_thread;  // 每个线程处理的元素数，决定grid size
+  double ms;                  // 调优时测得的耗时
+};
+
+/**
+ * 保存在磁盘上的kernel调优结果，按设备和驱动版本区分
+ * 文本格式，每行：设备key kernel名 workgroup_size elems_per_thread ms
+ */
+struct TuningDb {
+  /** 读取path中当前设备的结果，文件不存在时为空 */
+  void Load(const std::string &file, const vk::PhysicalDevice &phy_device);
+  /** 先写临时文件再rename，其他设备的结果保持不变 */
+  bool Save();
+  /** 没有调优过时返回nullptr */
+  const TuneConfig *Get(const std::string &kernel) const;
+  std::string path;
+  std::string device_key;  // vendorID-deviceID-driverVersion
+  std::unordered_map<std::string, TuneConfig> configs;
+};
+
+/** 特化常量，下标即constant_id。约定0为local_size_x，1为shared数组长度 */
+using SpecConstants = std::vector<uint32_t>;
+
+/** 每次dispatch的参数，通过push constant传入，布局和shader中的Params一致 */
+struct Params {
+  int count;            // 元素数量
+  uint32_t offset = 0;  // 从第offset个元素开始
+};
+
+/** bindless kernel的push constant，前两个成员和Params一致 */
+struct BindlessParams {
+  int count;
+  uint32_t offset = 0;
+  uint32_t input_idx = 0;  // 输入buffer在BindlessTable中的下标
+  uint32_t sum_idx = 0;    // 输出buffer在BindlessTable中的下标
 };
 
 struct Pipeline {
-  bool Init(const VkInfo &info, const DescriptorSet &desc, const std::vector<uint32_t> &shader_code);
+  /** cache为空时不使用pipeline cache；push_constant_size为0时不使用push constant */
+  bool Init(const VkInfo &info, const DescriptorSet &desc, std::span<const uint32_t> shader_code,
+    vk::PipelineCache cache = nullptr, const SpecConstants &spec = {}, uint32_t push_constant_size = 0);
   void Destroy();
   ~Pipeline() { Destroy(); }
   vk::Pipeline pipeline;
-  vk::PipelineLayout layout;
-  vk::PipelineCache cache;  // TODO: 有必要吗
+  vk::PipelineLayout layout;  // 由LayoutCache持有
   vk::ShaderModule shader_module;
   vk::Device device;
+  uint32_t local_size_x = 0;  // 特化后的block size，0表示使用shader中的默认值
+  uint32_t push_constant_size = 0;
+};
+
+/** buffer在一次dispatch中的访问方式 */
+enum class Access {
+  eRead,      // shader读（storage/uniform）
+  eWrite,     // shader写
+  eReadWrite, // shader读写
+  eIndirect,  // 作为dispatchIndirect的参数读取
+};
+
+struct BufferAccess {
+  Buffer *buffer;
+  Access access;
+  vk::DeviceSize offset = 0;
+  vk::DeviceSize size = VK_WHOLE_SIZE;
+};
+
+/**
+ * 录制compute命令，并根据每次dispatch声明的buffer访问自动插入barrier
+ * 只在RAW/WAR/WAW时对相关buffer插入buffer memory barrier，互不相关的dispatch之间不插barrier
+ */
+struct CommandRecorder {
+  /** one_time_submit为false时录制的command buffer可以重复提交 */
+  void Begin(vk::CommandBuffer cmd_buffer, bool one_time_submit = true);
+  /** 只根据accesses插入barrier，不dispatch。可用于一次性同步多个互不依赖的dispatch */
+  void Sync(const std::vector<BufferAccess> &accesses);
+  /** 只计算Sync需要的barrier并更新跟踪的状态，不录制命令 */
+  void PlanBarriers(const std::vector<BufferAccess> &accesses, std::vector<vk::BufferMemoryBarrier> &barriers,
+    vk::PipelineStageFlags &src_stages, vk::PipelineStageFlags &dst_stages);
+  void Dispatch(const Pipeline &pipeline, const DescriptorSet &desc, uint32_t x, uint32_t y, uint32_t z,
+    const std::vector<BufferAccess> &accesses);
+  /**
+   * desc需要用push=true创建。binding i指向bindings[i]的区间，同时按bindings插入barrier
+   * 不支持push descriptor时从desc_allocator分配set，desc_allocator为空时返回false
+   */
+  bool DispatchPush(const Pipeline &pipeline, const DescriptorSet &desc, const std::vector<BufferAccess> &bindings,
+    uint32_t x, uint32_t y, uint32_t z);
+  /** args会自动按eIndirect访问记录，accesses中无需再写 */
+  void DispatchIndirect(const Pipeline &pipeline, const DescriptorSet &desc, Buffer &args,
+    const std::vector<BufferAccess> &accesses);
+  /** 设置之后dispatch使用的push constant，不需要改buffer和descriptor */
+  template<typename T>
+  void PushConstants(const Pipeline &pipeline, const T &data) {
+    cmd.pushConstants(pipeline.layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(T), &data);
+  }
+  void End();
+  vk::CommandBuffer cmd;
+  int num_barriers = 0;  // 已插入的pipelineBarrier的数量
+  DescriptorAllocator *desc_allocator = nullptr;  // 不支持push descriptor时DispatchPush从这里分配set，每帧Reset
+
+private:
+  /** 记录某个buffer在上一次写之后的状态 */
+  struct BufferState {
+    vk::PipelineStageFlags write_stages;  // 上一次写的stage
+    vk::AccessFlags write_access;
+    vk::PipelineStageFlags visible_stages;  // 上一次写之后已经同步过的stage
+    vk::AccessFlags visible_access;
+    vk::PipelineStageFlags read_stages;   // 上一次写之后读过的stage
+  };
+  /** 和上一次绑定的pipeline、set相同时跳过，bindless时整个command buffer只绑定一次set */
+  void Bind(const Pipeline &pipeline, const DescriptorSet &desc);
+
+  std::unordered_map<VkBuffer, BufferState> states_;
+  vk::Pipeline bound_pipeline_;
+  vk::PipelineLayout bound_layout_;
+  vk::DescriptorSet bound_set_;
+};
+
+/** 等待GPU完成的方式 */
+enum class WaitPolicy {
+  eBlock,   // waitForFences，在驱动里睡眠，唤醒有延迟
+  eSpin,    // 一直轮询getFenceStatus，延迟最低但占满一个CPU核
+  eHybrid,  // 先轮询spin_us微秒，没完成再waitForFences
+};
+
+/** 按policy等待fence */
+bool WaitFence(vk::Device device, vk::Fence fence, WaitPolicy policy = WaitPolicy::eBlock, uint32_t spin_us = 50);
+
+/** 用timestamp query测量GPU耗时 */
+struct GpuTimer {
+  bool Init(const VkInfo &info, uint32_t num_timestamps);
+  void Destroy();
+  ~GpuTimer() { Destroy(); }
+  /** 录制timestamp之前调用 */
+  void Reset(vk::CommandBuffer cmd);
+  /** 在之前的命令都执行完后写入第idx个timestamp */
+  void Mark(vk::CommandBuffer cmd, uint32_t idx);
+  /** 等待结果，并获取第begin个到第end个timestamp之间的毫秒数 */
+  bool GetElapsed(uint32_t begin, uint32_t end, double &ms);
+
+  vk::QueryPool pool;
+  vk::Device device;
+  uint32_t num_queries = 0;
+  double period;         // 每个tick的纳秒数
+  uint64_t valid_mask;   // timestamp的有效位
 };
 
 struct float3 {
@@ -96,13 +388,52 @@ struct Input {
   alignas(4) int num2;
 };
 
+class PipelineRegistry;
+class ShaderCompiler;
+class ShaderWatcher;
+
 class Benchmark {
 public:
-  Benchmark(int elem_num);
+  /** lazy为true时pipeline在第一次使用时才编译，同时后台线程提前编译；否则启动时并行编译所有pipeline */
+  Benchmark(int elem_num, bool lazy = false);
   ~Benchmark();
 
   bool CreateSuccess() const {return create_succrss_;};
+  void SetWaitPolicy(WaitPolicy policy, uint32_t spin_us = 50) { wait_policy_ = policy; spin_us_ = spin_us; }
   bool Run();
+  /** 用TaskGraph描述同样的计算流程，编译一次后重复执行 */
+  bool RunTaskGraph(int repeat = 10);
+  /** 对比shared memory树形规约和subgroupAdd规约，array需要先由Run写入 */
+  bool RunSubgroupCompare(int repeat = 10);
+  /** 对比两遍规约和原子操作规约的耗时，以及多次运行结果是否按位相同。array需要先由Run写入 */
+  bool RunDeterministic(int repeat = 10);
+  /** 用随机输入对比普通求和与补偿求和的误差（相对CPU上double累加的结果）和吞吐 */
+  bool RunAccuracy(int repeat = 10);
+  /** 对比sum_inputs+array_reduction两个kernel和融合后的sum_inputs_reduction */
+  bool RunFused(int repeat = 10);
+  /** 用协程同时发起大量小的GPU job，由一个完成线程恢复 */
+  bool RunAsync(int num_jobs = 1000, int job_elem_num = 1024);
+  /** 每帧把inputs切成小块，每次dispatch用push descriptor绑定不同的区间 */
+  bool RunStreaming(int repeat = 10, int slice_elem_num = 4096);
+  /** 和RunStreaming相同的切分，但每块提前注册到bindless表中，每次dispatch只更新push constant中的下标 */
+  bool RunBindless(int repeat = 10, int slice_elem_num = 4096);
+  /** 在小输入上对比不同WaitPolicy从提交到返回的延迟（p50/p99） */
+  bool RunLatency(int repeat = 1000, int small_elem_num = 4096);
+  /**
+   * 在当前设备上遍历每个kernel的workgroup size和每个线程处理的元素数，用timestamp测量并选最快的
+   * 结果保存到调优数据库，并重新编译pipeline。之后启动时自动使用
+   */
+  bool Autotune(int repeat = 5);
+  /** 对比spirv-opt优化前后每个kernel的大小和耗时，需要用SPIRV_OPT编译 */
+  bool RunOptCompare(int repeat = 10);
+  /** 把数组切分到所有可用的GPU上同时规约，不需要创建Benchmark */
+  static bool RunMultiDevice(int elem_num, int repeat = 5);
+#ifdef USE_SHADERC
+  /** 从shader_dir中的GLSL源码重新编译所有pipeline，并在后台监视源码的修改 */
+  bool EnableHotReload(const std::string &shader_dir);
+  /** 重新编译源码或include的文件修改过的shader并替换pipeline，返回替换的数量 */
+  int ReloadChangedShaders();
+#endif
 
 private:
   bool InitVkInfo();
@@ -111,16 +442,54 @@ private:
   bool CreatePipelines();
   bool AllocateCommandBuffer();
   bool CreateFence();
+  /** 根据设备的subgroup大小和限制选择block size，必须是2的幂 */
+  uint32_t ChooseWorkgroupSize();
+  /** 设备支持的最大block size（2的幂，不超过1024） */
+  uint32_t MaxWorkgroupSize();
+  /** Run中间接dispatch的规约kernel，设备支持时是array_reduction_subgroup */
+  const char *ReductionKernel() const;
+  /** 根据默认block size和调优结果设置每个pipeline的特化常量 */
+  void UpdateSpecs();
+  /**
+   * 名为name的kernel处理num个元素的grid size（kernel中是grid-stride循环）
+   * 调优过时按每个线程处理的元素数计算，否则不超过max_groups_
+   */
+  uint32_t GridSize(const std::string &name, int num) const;
+  /** 设备不支持float原子加时打印跳过what的信息并返回false */
+  bool RequireAtomicFloat(const char *what) const;
+  /** 录制array前num个元素的两遍规约，结果写到sum。kernel可以是array_reduction_two_pass或array_reduction_kahan */
+  bool RecordTwoPassReduction(CommandRecorder &recorder, int num,
+    const std::string &kernel = "array_reduction_two_pass");
+  /** 增大slice_elem_num，使每块的起始位置满足storage buffer的offset对齐 */
+  int AlignSlice(int slice_elem_num) const;
+  /** 单独提交repeat次dispatch，返回平均GPU耗时 */
+  bool MeasureDispatch(const Pipeline &pipeline, const DescriptorSet &desc, uint32_t grid, int repeat, double &ms);
 
 
   VkInfo vk_info_;
   std::unordered_map<std::string, Buffer> buffers_;
   std::unordered_map<std::string, DescriptorSet> desc_sets_;
-  std::unordered_map<std::string, Pipeline> pipelines_;
+  BindlessTable bindless_;  // 设备不支持descriptor indexing时不初始化
+  std::unordered_map<std::string, uint32_t> bindless_idx_;  // buffer在bindless_中的下标
+  std::unique_ptr<PipelineRegistry> pipelines_;
+  std::unordered_map<std::string, SpecConstants> specs_;  // 每个pipeline的特化常量
+  TuningDb tuning_db_;
+#ifdef USE_SHADERC
+  std::unique_ptr<ShaderCompiler> shader_compiler_;
+  std::unique_ptr<ShaderWatcher> shader_watcher_;
+#endif
   vk::CommandBuffer cmd_buffer_;
   vk::Fence fence_;
+  GpuTimer timer_;
+  PipelineCache pipeline_cache_;
+  WaitPolicy wait_policy_ = WaitPolicy::eBlock;
+  uint32_t spin_us_ = 50;
 
   int elem_num_;
+  bool lazy_;
+  uint32_t workgroup_size_ = 128;
+  uint32_t max_groups_ = 128;
+  bool subgroup_reduction_ = false;  // 设备支持subgroup arithmetic时用array_reduction_subgroup规约
   bool create_succrss_;
 };
 
@@ -44,94 +44,90 @@ function(spv_to_vector spv_file output_vec use_decimal is_big_endian)
   endif()
 endfunction()
 
-# 将指定路径下所有.comp文件转存到一个hpp中
+# 内容变化时才写文件，避免更新时间戳导致依赖它的目标重新编译
+# 先写到临时文件，再用copy_if_different替换
+# NOTE: 内容不变时文件不会比输入新，构建规则要用另外的stamp文件作为OUTPUT
 # 参数：
-#   shader_dir: 包含.comp文件的目录。会递归查找。要求.comp文件的文件名不重复。
-#   output_hpp: 输出的hpp文件路径
-#   namespace: 输出hpp文件中的命名空间
-#   variable_name: 输出hpp文件中的变量
-#   use_decimal: 是否使用十进制存储shader
-#   is_big_endian: 是否是大端序
-function(vulkan_shader_compile shader_dir output_hpp namespace variable_name use_decimal is_big_endian)
-  if(is_big_endian)
-    message(STATUS "Interpreting shader in big endian.")
-  else()
-    message(STATUS "Interpreting shader in little endian.")
+#   file_path: 文件路径
+#   content: 文件内容
+function(write_if_different file_path content)
+  file(WRITE ${file_path}.tmp "${content}")
+  execute_process(COMMAND ${CMAKE_COMMAND} -E copy_if_different ${file_path}.tmp ${file_path}
+                  RESULT_VARIABLE result)
+  file(REMOVE ${file_path}.tmp)
+  if(NOT ${result} EQUAL 0)
+    message(FATAL_ERROR "Failed to write ${file_path}")
   endif()
+endfunction()
 
-  # 查找glslangValidator可执行路径
-  find_program(GLS_LANG_VALIDATOR_PATH NAMES glslangValidator)
-  if(GLS_LANG_VALIDATOR_PATH STREQUAL "GLS_LANG_VALIDATOR_PATH-NOTFOUND")
-      message(FATAL_ERROR "glslangValidator not found.")
-      return()
-  endif()
+# 把SPIR-V写成逗号分隔的uint32_t列表，用于#include到数组的初始化中
+# 参数：
+#   spv_file: SPIR-V文件路径
+#   inc_file: 输出的.inc文件路径
+#   use_decimal: 是否使用十进制
+#   is_big_endian: 是否是大端序
+function(write_spv_inc spv_file inc_file use_decimal is_big_endian)
+  spv_to_vector(${spv_file} spv_vector ${use_decimal} ${is_big_endian})
+  write_if_different(${inc_file} "${spv_vector}\n")
+endfunction()
 
-  # 保证hpp的路径存在
+# 生成hpp：每个shader一个inline constexpr数组，再加一个名字到std::span的查找表
+# 不在运行时分配内存，可以被多个源文件include
+# 参数：
+#   output_hpp: 输出的hpp文件路径
+#   namespace: 输出hpp文件中的命名空间
+#   variable_name: 查找表的变量名
+#   spv_names: shader名字的列表
+#   spv_incs: 和spv_names一一对应的.inc文件列表
+function(write_spv_header output_hpp namespace variable_name spv_names spv_incs)
   get_filename_component(hpp_dir ${output_hpp} DIRECTORY)
-  if(NOT EXISTS "${hpp_dir}")
-    file(MAKE_DIRECTORY ${hpp_dir})
+  set(content "#pragma once\n")
+  string(APPEND content "#include <cstdint>\n")
+  string(APPEND content "#include <span>\n")
+  string(APPEND content "#include <string_view>\n")
+  string(APPEND content "namespace ${namespace} {\n")
+  set(table "")
+  list(LENGTH spv_names num_spv)
+  if(num_spv GREATER 0)
+    math(EXPR last_idx "${num_spv} - 1")
+    foreach(idx RANGE ${last_idx})
+      list(GET spv_names ${idx} spv_name)
+      list(GET spv_incs ${idx} spv_inc)
+      string(MAKE_C_IDENTIFIER "${spv_name}_spv" array_name)
+      file(RELATIVE_PATH inc_path ${hpp_dir} ${spv_inc})
+      string(APPEND content "inline constexpr uint32_t ${array_name}[] = {\n#include \"${inc_path}\"\n};\n")
+      string(APPEND table "  {\"${spv_name}\", ${array_name}},\n")
+    endforeach()
   endif()
-
-  # 写hpp的开头
-  file(WRITE ${output_hpp} "#pragma once\n")
-  file(APPEND ${output_hpp} "#include <unordered_map>\n")
-  file(APPEND ${output_hpp} "#include <vector>\n")
-  file(APPEND ${output_hpp} "#include <string>\n")
-  file(APPEND ${output_hpp} "namespace ${namespace} {\n")
-  file(APPEND ${output_hpp} "std::unordered_map<std::string, std::vector<uint32_t>> ${variable_name} = {\n")
-
-  # 获取所有着色器文件
-  file(GLOB_RECURSE  comp_files "${shader_dir}/*.comp")
-  list(LENGTH comp_files num_comp)
-  message(STATUS "Number of .comp files: ${num_comp}")
-
-  # 遍历每个comp
-  set(first_file TRUE)
-  foreach(comp_file IN LISTS comp_files)
-    get_filename_component(comp_name ${comp_file} NAME_WE)
-    # .comp => .spv
-    set(spv_file "${comp_file}.spv")
-    execute_process(  # NOTE: 下面COMMAND后面的内容不能放到一个大双引号里
-            COMMAND ${GLS_LANG_VALIDATOR_PATH} -V ${comp_file} -o ${spv_file}
-            RESULT_VARIABLE result
-    )
-    if(NOT ${result} EQUAL 0)
-      message(FATAL_ERROR "Failed to compile compute shader ${comp_file} to SPIR-V ${spv_file}")
-    endif ()
-    # .spv转vector<uint32_t>
-    spv_to_vector(${spv_file} spv_vector ${use_decimal} ${is_big_endian})
-    # 写入头文件
-    if(NOT first_file)
-      file(APPEND ${output_hpp} ",\n")
-    endif()
-    set(first_file FALSE)
-    file(APPEND ${output_hpp} "  {\"${comp_name}\", {${spv_vector}}}")
-  endforeach()
-
-  # 写hpp的结尾
-  file(APPEND ${output_hpp} "\n};\n") # unordered_map的结尾
-  file(APPEND ${output_hpp} "}\n")  # namespace的结尾
+  string(APPEND content "struct SpvEntry {\n  std::string_view name;\n  std::span<const uint32_t> code;\n};\n")
+  string(APPEND content "inline constexpr SpvEntry ${variable_name}[] = {\n${table}};\n")
+  string(APPEND content "/** 按名字查找shader，找不到时返回空的span */\n")
+  string(APPEND content "constexpr std::span<const uint32_t> Find(std::span<const SpvEntry> table, std::string_view name) {\n")
+  string(APPEND content "  for (auto &entry: table)\n    if (entry.name == name) return entry.code;\n  return {};\n}\n")
+  string(APPEND content "}\n")  # namespace的结尾
+  write_if_different(${output_hpp} "${content}")
 endfunction()
 
-# 检查输入参数是否为空
-if(${INPUT_SHADER_DIR} STREQUAL "")
-    message(FATAL_ERROR "No input file dir provided via 'INPUT_SHADER_DIR'.")
-endif()
-
-if(${OUTPUT_HEADER_FILE} STREQUAL "")
-    message(FATAL_ERROR "No output file path provided via 'OUTPUT_HEADER_FILE'.")
-endif()
-
- if(${HEADER_NAMESPACE} STREQUAL "")
-     message(FATAL_ERROR "No header namespace provided via 'HEADER_NAMESPACE'.")
- endif()
-
-if(${VARIABLE_NAME} STREQUAL "")
-    message(FATAL_ERROR "No variable name provided via 'VARIABLE_NAME'.")
-endif()
-
-option(USE_DECIMAL "Use decimal representation for shader code" ON)
+option(USE_DECIMAL "Use decimal representation for shader code" OFF)  # 十六进制不需要逐个转换，生成更快
 option(IS_BIG_ENDIAN "Use big endian byte order" OFF)
 
-# 调用函数进行编译
-vulkan_shader_compile(${INPUT_SHADER_DIR} ${OUTPUT_HEADER_FILE} ${HEADER_NAMESPACE} ${VARIABLE_NAME} ${USE_DECIMAL} ${IS_BIG_ENDIAN})
\ No newline at end of file
+if(DEFINED SPV_FILE)
+  # 模式1：只把一个SPIR-V写成.inc，用于每个shader单独的构建规则
+  # 参数：SPV_FILE、INC_FILE，可选的UNOPT_FILE用于输出spirv-opt前后的大小
+  write_spv_inc(${SPV_FILE} ${INC_FILE} ${USE_DECIMAL} ${IS_BIG_ENDIAN})
+  if(DEFINED UNOPT_FILE)
+    get_filename_component(spv_name ${SPV_FILE} NAME_WE)
+    file(SIZE ${UNOPT_FILE} unopt_size)
+    file(SIZE ${SPV_FILE} opt_size)
+    math(EXPR opt_percent "100 * ${opt_size} / ${unopt_size}")
+    message(STATUS "spirv-opt ${spv_name}: ${unopt_size} -> ${opt_size} bytes (${opt_percent}%)")
+  endif()
+elseif(DEFINED SPV_NAMES)
+  # 模式2：根据已经生成的.inc写hpp。列表用|分隔，避免命令行中的分号被拆开
+  # 参数：OUTPUT_HEADER_FILE、HEADER_NAMESPACE、VARIABLE_NAME、SPV_NAMES、SPV_INCS
+  string(REPLACE "|" ";" spv_names "${SPV_NAMES}")
+  string(REPLACE "|" ";" spv_incs "${SPV_INCS}")
+  write_spv_header(${OUTPUT_HEADER_FILE} ${HEADER_NAMESPACE} ${VARIABLE_NAME} "${spv_names}" "${spv_incs}")
+else()
+  message(FATAL_ERROR "Either SPV_FILE or SPV_NAMES must be provided.")
+endif()
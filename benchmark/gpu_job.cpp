@@ -0,0 +1,76 @@
+#include "gpu_job.h"
+
+using namespace std;
+
+bool GpuJobQueue::Job::await_suspend(coroutine_handle<> handle) {
+  result = queue.Submit(cmd_buffer, fence);
+  if (result != vk::Result::eSuccess)
+    return false;  // 提交失败，不挂起
+  // NOTE: 登记之后协程可能马上在完成线程上恢复，不能再访问this
+  queue.Watch(fence, handle, &result);
+  return true;
+}
+
+GpuJobQueue::GpuJobQueue(const VkInfo &info) : device_(info.device), queue_(info.queue) {
+  thread_ = thread(&GpuJobQueue::CompletionLoop, this);
+}
+
+GpuJobQueue::~GpuJobQueue() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();  // 等所有登记的job完成
+}
+
+vk::Result GpuJobQueue::Submit(vk::CommandBuffer cmd_buffer, vk::Fence fence) {
+  vk::SubmitInfo submit_info;
+  submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer);
+  lock_guard<mutex> lock(queue_mutex_);
+  return queue_.submit(1, &submit_info, fence);
+}
+
+void GpuJobQueue::Watch(vk::Fence fence, coroutine_handle<> handle, vk::Result *result) {
+  {
+    lock_guard<mutex> lock(mutex_);
+    pending_.push_back({fence, handle, result});
+  }
+  cv_.notify_one();
+}
+
+void GpuJobQueue::CompletionLoop() {
+  vector<Waiter> watching;
+  vector<vk::Fence> fences;
+  vector<Waiter> ready;
+  while (true) {
+    {
+      unique_lock<mutex> lock(mutex_);
+      cv_.wait(lock, [&] { return stop_ || !pending_.empty() || !watching.empty(); });
+      if (stop_ && pending_.empty() && watching.empty()) break;
+      watching.insert(watching.end(), pending_.begin(), pending_.end());
+      pending_.clear();
+    }
+    //! 等任意一个fence，超时后回去接收新登记的job
+    fences.clear();
+    for (auto &job: watching)
+      fences.push_back(job.fence);
+    auto res = device_.waitForFences(fences.size(), fences.data(), VK_FALSE, 1000000);  // 1ms
+    if (res == vk::Result::eTimeout) continue;
+    if (res != vk::Result::eSuccess)
+      printf("[Error] wait for GPU jobs failed, result is %s\n", vk::to_string(res).c_str());
+    //! 恢复已经完成的协程
+    ready.clear();
+    for (auto it = watching.begin(); it != watching.end();) {
+      if (res != vk::Result::eSuccess || device_.getFenceStatus(it->fence) == vk::Result::eSuccess) {
+        *it->result = res;
+        ready.push_back(*it);
+        it = watching.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (auto &job: ready)
+      job.handle.resume();
+  }
+}
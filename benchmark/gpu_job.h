@@ -0,0 +1,63 @@
+#pragma once
+#include "benchmark.h"
+#include <coroutine>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+/**
+ * 协程提交GPU job用的queue：提交后挂起协程，由一个完成线程等待fence并恢复协程
+ * 这样少量host线程就能同时处理大量在GPU上执行的job
+ */
+class GpuJobQueue {
+public:
+  explicit GpuJobQueue(const VkInfo &info);
+  ~GpuJobQueue();
+
+  /** co_await queue.Run(cmd, fence)：返回vkQueueSubmit或fence的结果 */
+  struct Job {
+    GpuJobQueue &queue;
+    vk::CommandBuffer cmd_buffer;
+    vk::Fence fence;
+    vk::Result result = vk::Result::eSuccess;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> handle);
+    vk::Result await_resume() const noexcept { return result; }
+  };
+  Job Run(vk::CommandBuffer cmd_buffer, vk::Fence fence) { return {*this, cmd_buffer, fence}; }
+
+  /** 线程安全地提交command buffer */
+  vk::Result Submit(vk::CommandBuffer cmd_buffer, vk::Fence fence);
+  /** fence signal后在完成线程上把结果写到result，再恢复handle */
+  void Watch(vk::Fence fence, std::coroutine_handle<> handle, vk::Result *result);
+
+private:
+  struct Waiter {
+    vk::Fence fence;
+    std::coroutine_handle<> handle;
+    vk::Result *result;
+  };
+  void CompletionLoop();
+
+  vk::Device device_;
+  vk::Queue queue_;
+  std::mutex queue_mutex_;  // NOTE: vkQueueSubmit需要外部同步
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Waiter> pending_;  // 新登记、完成线程还没开始等的job
+  bool stop_ = false;
+  std::thread thread_;
+};
+
+/** 不需要返回值的协程，创建后立即执行，结束时自动销毁 */
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
@@ -1,14 +1,41 @@
 #include "benchmark.h"
+#include <chrono>
+#include <thread>
 
 using namespace std;
 
-int main() {
+int main(int argc, char **argv) {
   int elem_num = 1<<20;
-  Benchmark benchmark(elem_num);
+  if (argc > 1 && string(argv[1]) == "--multi-device")  // 把一个大数组切分到所有GPU上
+    return Benchmark::RunMultiDevice(elem_num * 16) ? 0 : -1;
+  bool lazy = argc > 1 && string(argv[1]) == "--lazy";  // pipeline第一次使用时才编译
+  Benchmark benchmark(elem_num, lazy);
   if (!benchmark.CreateSuccess()) {
     printf("[FATAL] Create Benchmark Failed!\n");
     return -1;
   }
+#ifdef USE_SHADERC
+  if (argc > 1 && string(argv[1]) == "--watch") {  // 修改shader源码后自动重新编译，Ctrl+C退出
+    if (!benchmark.EnableHotReload(SHADER_DIR)) return -1;
+    while (true) {
+      if (benchmark.ReloadChangedShaders() > 0)
+        benchmark.RunFused();
+      this_thread::sleep_for(chrono::milliseconds(200));
+    }
+  }
+#endif
+  if (argc > 1 && string(argv[1]) == "--autotune")  // 调优结果保存后，之后启动时自动使用
+    benchmark.Autotune();
   benchmark.Run();
+  benchmark.RunTaskGraph();
+  benchmark.RunSubgroupCompare();
+  benchmark.RunDeterministic();
+  benchmark.RunAccuracy();
+  benchmark.RunFused();
+  benchmark.RunAsync();
+  benchmark.RunStreaming();
+  benchmark.RunBindless();
+  benchmark.RunLatency();
+  benchmark.RunOptCompare();
   return 0;
 }
\ No newline at end of file
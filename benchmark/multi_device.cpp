@@ -0,0 +1,175 @@
+#include "multi_device.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+MultiDeviceReduction::MultiDeviceReduction(int elem_num, span<const uint32_t> shader_code)
+    : data_(elem_num, 1.f), elem_num_(elem_num) {
+  create_success_ = false;
+  if (!CreateInstance(instance_)) {
+    printf("[FATAL] Failed to initialize Vulkan instance.\n");
+    return;
+  }
+  //! 找到所有满足要求的设备
+  vector<vk::PhysicalDevice> suitable_devices;
+  for (auto &phy_device: instance_.enumeratePhysicalDevices()) {
+    auto prop = phy_device.getProperties();
+    if (CheckDeviceSuitable(phy_device) >= 0 || !SupportsAtomicFloat(phy_device)) {  // NOTE: 各设备的部分和用原子加累加
+      cout << "[INFO] Skip unsuitable device " << prop.deviceName << endl;
+      continue;
+    }
+    cout << "[INFO] Use device " << prop.deviceName << ", type: " << vk::to_string(prop.deviceType) << endl;
+    suitable_devices.push_back(phy_device);
+  }
+  if (suitable_devices.empty()) {
+    printf("[FATAL] No suitable physical device found.\n");
+    return;
+  }
+  // NOTE: device group可以用一个逻辑设备驱动多个GPU，但是需要同型号的GPU和驱动支持。
+  //       这里每个物理设备单独创建VkInfo，异构的多GPU也能用
+  for (auto &group: instance_.enumeratePhysicalDeviceGroups())
+    if (group.physicalDeviceCount > 1)
+      printf("[INFO] Found device group with %u physical devices\n", group.physicalDeviceCount);
+  //! 每个设备创建自己的VkInfo和pipeline
+  for (auto &phy_device: suitable_devices) {
+    devices_.push_back(make_unique<DeviceContext>());
+    if (!CreateContext(*devices_.back(), phy_device, shader_code)) {
+      printf("[FATAL] Failed to create context on device %s.\n", phy_device.getProperties().deviceName.data());
+      return;
+    }
+    devices_.back()->ratio = 1.0 / suitable_devices.size();
+  }
+  create_success_ = true;
+}
+
+MultiDeviceReduction::~MultiDeviceReduction() {
+  if (!create_success_) return;
+  for (auto &ctx: devices_) {
+    VkInfo info = ctx->info;
+    info.device.destroyFence(ctx->fence);
+    ctx.reset();  // 先析构buffer、pipeline等，再销毁device
+    info.Destroy();
+  }
+  instance_.destroy();
+}
+
+bool MultiDeviceReduction::CreateContext(DeviceContext &ctx, vk::PhysicalDevice phy_device,
+                                         span<const uint32_t> shader_code) {
+  if (!InitDevice(ctx.info, instance_, phy_device))
+    return false;
+  ctx.info.owns_instance = false;
+  ctx.count = SIZE_MAX;  // 保证第一次SetSlice时会上传数据
+  bool create_success = true;
+  create_success &= ctx.array.Init(ctx.info, sizeof(float), 1, vk::BufferUsageFlagBits::eStorageBuffer,
+    MEMORY_CPU_TO_GPU);
+  create_success &= ctx.sum.Init(ctx.info, sizeof(float), 1, vk::BufferUsageFlagBits::eStorageBuffer,
+    MEMORY_GPU_TO_CPU);
+  if (!create_success) return false;
+  if (!ctx.desc.Init(ctx.info, {&ctx.array, &ctx.sum}) ||
+      !ctx.pipeline.Init(ctx.info, ctx.desc, shader_code, nullptr, {}, sizeof(Params)) || !ctx.timer.Init(ctx.info, 2))
+    return false;
+  vk::CommandBufferAllocateInfo alloc_info(ctx.info.cmd_pool, vk::CommandBufferLevel::ePrimary, 1);
+  VK_CHECK(ctx.info.device.allocateCommandBuffers(&alloc_info, &ctx.cmd_buffer));
+  vk::FenceCreateInfo fence_info;
+  VK_CHECK(ctx.info.device.createFence(&fence_info, nullptr, &ctx.fence));
+  return true;
+}
+
+bool MultiDeviceReduction::SetSlice(DeviceContext &ctx, size_t offset, size_t count) {
+  if (ctx.offset == offset && ctx.count == count) return true;
+  ctx.offset = offset;
+  ctx.count = count;
+  //! 只在切片变大时重新创建array，array至少要有一个元素才能创建
+  if (count > ctx.array.num_elems) {
+    ctx.array.Destroy();
+    if (!ctx.array.Init(ctx.info, sizeof(float), count, vk::BufferUsageFlagBits::eStorageBuffer, MEMORY_CPU_TO_GPU))
+      return false;
+    ctx.desc.Update({&ctx.array, &ctx.sum});
+  }
+  // NOTE: kernel只读前count个元素，array比切片大时多出来的部分不用管
+  return count == 0 || ctx.array.SetData(data_.data() + offset, count);
+}
+
+bool MultiDeviceReduction::Submit(DeviceContext &ctx) {
+  if (!ctx.sum.SetZero()) return false;
+  CommandRecorder recorder;
+  recorder.Begin(ctx.cmd_buffer);
+  ctx.timer.Reset(ctx.cmd_buffer);
+  // NOTE: array只保存本设备的切片，所以offset为0
+  recorder.PushConstants(ctx.pipeline, Params{int(ctx.count)});
+  ctx.timer.Mark(ctx.cmd_buffer, 0);
+  recorder.Dispatch(ctx.pipeline, ctx.desc, 128, 1, 1,
+    {{&ctx.array, Access::eRead}, {&ctx.sum, Access::eReadWrite}});
+  ctx.timer.Mark(ctx.cmd_buffer, 1);
+  recorder.End();
+  vk::SubmitInfo submit_info;
+  submit_info.setCommandBufferCount(1).setPCommandBuffers(&ctx.cmd_buffer);
+  VK_CHECK(ctx.info.queue.submit(1, &submit_info, ctx.fence));
+  return true;
+}
+
+bool MultiDeviceReduction::Wait(DeviceContext &ctx, float &sum, double &ms) {
+  VK_CHECK(ctx.info.device.waitForFences(1, &ctx.fence, VK_TRUE, UINT64_MAX));
+  VK_CHECK(ctx.info.device.resetFences(1, &ctx.fence));
+  if (!ctx.timer.GetElapsed(0, 1, ms)) return false;
+  return ctx.sum.GetData(&sum, 1);
+}
+
+void MultiDeviceReduction::Rebalance() {
+  //! 有设备没测到有效的吞吐量时（切片为空或计时出错）保留上一次的比例
+  double total = 0;
+  for (auto &ctx: devices_) {
+    if (ctx->throughput <= 0) return;
+    total += ctx->throughput;
+  }
+  //! 每个设备至少分到均分时的10%，避免某次测得偏低后再也分不到任务
+  const double min_share = 0.1 / devices_.size();
+  double clamped_total = 0;
+  for (auto &ctx: devices_) {
+    ctx->ratio = max(ctx->throughput / total, min_share);
+    clamped_total += ctx->ratio;
+  }
+  for (auto &ctx: devices_)
+    ctx->ratio /= clamped_total;
+}
+
+bool MultiDeviceReduction::Run(int repeat) {
+  printf("[INFO] Reduce %d elements on %zu devices\n", elem_num_, devices_.size());
+  for (int r = 0; r < repeat; r++) {
+    //! 按比例切分，最后一个设备拿剩下的
+    size_t offset = 0;
+    for (int d = 0; d < devices_.size(); d++) {
+      auto &ctx = *devices_[d];
+      size_t count = d + 1 == devices_.size() ? elem_num_ - offset : size_t(elem_num_ * ctx.ratio);
+      if (!SetSlice(ctx, offset, count)) {
+        printf("[FATAL] Failed to set data on device %d.\n", d);
+        return false;
+      }
+      offset += count;
+    }
+    //! 所有设备同时执行
+    auto start = chrono::steady_clock::now();
+    for (auto &ctx: devices_)
+      if (!Submit(*ctx)) return false;
+    double total_sum = 0;
+    for (int d = 0; d < devices_.size(); d++) {
+      auto &ctx = *devices_[d];
+      float sum;
+      double ms;
+      if (!Wait(ctx, sum, ms)) {
+        printf("[FATAL] Failed to run on device %d.\n", d);
+        return false;
+      }
+      total_sum += sum;
+      ctx.throughput = ms > 0 ? ctx.count / ms : 0;
+      printf("[INFO] Round %d device %d: %zu elements (%.1f%%), %.3f ms, %.2f Melem/s\n", r, d, ctx.count,
+        ctx.ratio * 100, ms, ctx.throughput * 1e-3);
+    }
+    auto elapsed = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("[INFO] Round %d: sum %f (CPU %d), %.3f ms in total\n", r, total_sum, elem_num_, elapsed);
+    Rebalance();
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "benchmark.h"
+#include <memory>
+
+/**
+ * 把一个数组切分到所有可用的GPU上同时规约，最后在host上合并
+ * 每个设备有自己的VkInfo，切分比例根据测得的每个设备的吞吐量调整
+ */
+class MultiDeviceReduction {
+public:
+  MultiDeviceReduction(int elem_num, std::span<const uint32_t> shader_code);
+  ~MultiDeviceReduction();
+
+  bool CreateSuccess() const { return create_success_; }
+  /** 第一次均分，之后每次按上一次测得的吞吐量重新分配 */
+  bool Run(int repeat = 5);
+
+private:
+  struct DeviceContext {
+    VkInfo info;
+    Buffer array, sum;
+    DescriptorSet desc;
+    Pipeline pipeline;
+    GpuTimer timer;
+    vk::CommandBuffer cmd_buffer;
+    vk::Fence fence;
+    size_t offset = 0, count = 0;  // 分到的数组切片
+    double ratio = 0;              // 分到的元素比例
+    double throughput = 0;         // 测得的吞吐量，元素/ms
+  };
+  bool CreateContext(DeviceContext &ctx, vk::PhysicalDevice phy_device, std::span<const uint32_t> shader_code);
+  /** 切片变化时上传数据，只有切片变大时才重新创建array */
+  bool SetSlice(DeviceContext &ctx, size_t offset, size_t count);
+  bool Submit(DeviceContext &ctx);
+  bool Wait(DeviceContext &ctx, float &sum, double &ms);
+  /** 按吞吐量重新计算切分比例，每个设备有最小比例；有无效测量时不调整 */
+  void Rebalance();
+
+  vk::Instance instance_;
+  std::vector<std::unique_ptr<DeviceContext>> devices_;
+  std::vector<float> data_;
+  int elem_num_;
+  bool create_success_;
+};
@@ -0,0 +1,104 @@
+#include "pipeline_registry.h"
+#include <chrono>
+
+using namespace std;
+
+void PipelineRegistry::Init(const VkInfo &info, vk::PipelineCache cache) {
+  info_ = &info;
+  cache_ = cache;
+}
+
+void PipelineRegistry::Register(const string &name, const DescriptorSet &desc, span<const uint32_t> shader_code,
+                                const SpecConstants &spec, uint32_t push_constant_size) {
+  auto entry = make_unique<Entry>();
+  entry->desc = &desc;
+  entry->shader_code = shader_code;
+  entry->spec = spec;
+  entry->push_constant_size = push_constant_size;
+  entries_[name] = move(entry);
+}
+
+bool PipelineRegistry::Compile(const string &name, Entry &entry) {
+  // NOTE: pipeline cache没有用EXTERNALLY_SYNCHRONIZED创建，多个线程可以同时用它编译
+  call_once(entry.once, [&]() {
+    auto start = chrono::steady_clock::now();
+    entry.success = entry.pipeline.Init(*info_, *entry.desc, entry.shader_code, cache_, entry.spec,
+      entry.push_constant_size);
+    entry.compile_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    printf("[INFO] Pipeline %-22s %s in %.3f ms\n", name.c_str(), entry.success ? "compiled" : "FAILED",
+      entry.compile_ms);
+  });
+  return entry.success;
+}
+
+Pipeline *PipelineRegistry::Get(const string &name) {
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    printf("[ERROR] Pipeline %s is not registered\n", name.c_str());
+    return nullptr;
+  }
+  return Compile(name, *it->second) ? &it->second->pipeline : nullptr;
+}
+
+bool PipelineRegistry::Reload(const string &name, span<const uint32_t> shader_code,
+                              const SpecConstants &spec) {
+  WaitWarmup();
+  auto it = entries_.find(name);
+  if (it == entries_.end()) {
+    printf("[ERROR] Pipeline %s is not registered\n", name.c_str());
+    return false;
+  }
+  auto &old = *it->second;
+  auto entry = make_unique<Entry>();
+  entry->desc = old.desc;
+  entry->owned_code.assign(shader_code.begin(), shader_code.end());
+  entry->shader_code = entry->owned_code;
+  entry->spec = spec;
+  entry->push_constant_size = old.push_constant_size;
+  if (!Compile(name, *entry))
+    return false;
+  it->second = move(entry);
+  return true;
+}
+
+vector<string> PipelineRegistry::Names() const {
+  vector<string> names;
+  for (auto &entry: entries_)
+    names.push_back(entry.first);
+  return names;
+}
+
+void PipelineRegistry::Warmup(const vector<string> &names, uint32_t num_threads) {
+  WaitWarmup();
+  warmup_names_ = names;
+  warmup_next_ = 0;
+  stop_ = false;
+  auto worker = [this]() {
+    for (size_t i = warmup_next_++; i < warmup_names_.size() && !stop_; i = warmup_next_++) {
+      auto it = entries_.find(warmup_names_[i]);
+      if (it != entries_.end())
+        Compile(it->first, *it->second);
+    }
+  };
+  for (uint32_t i = 0; i < max(num_threads, 1u); i++)
+    warmup_threads_.emplace_back(worker);
+}
+
+void PipelineRegistry::WaitWarmup() {
+  for (auto &t: warmup_threads_)
+    t.join();
+  warmup_threads_.clear();
+}
+
+double PipelineRegistry::TotalCompileMs() const {
+  double ms = 0;
+  for (auto &entry: entries_)
+    ms += entry.second->compile_ms;
+  return ms;
+}
+
+void PipelineRegistry::Destroy() {
+  stop_ = true;  // 没开始编译的不再编译
+  WaitWarmup();
+  entries_.clear();
+}
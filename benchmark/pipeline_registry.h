@@ -0,0 +1,61 @@
+#pragma once
+#include "benchmark.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/**
+ * 按名字管理pipeline：注册时只记录参数，第一次Get时才编译
+ * 也可以用Warmup在后台线程中按优先级提前编译，Get到正在编译的pipeline时会等它编译完
+ */
+class PipelineRegistry {
+public:
+  ~PipelineRegistry() { Destroy(); }
+
+  /** cache为空时不使用pipeline cache */
+  void Init(const VkInfo &info, vk::PipelineCache cache = nullptr);
+  /** 只记录参数，不编译也不复制shader_code。desc和shader_code需要一直有效；必须在Get和Warmup之前注册完 */
+  void Register(const std::string &name, const DescriptorSet &desc, std::span<const uint32_t> shader_code,
+    const SpecConstants &spec = {}, uint32_t push_constant_size = 0);
+  /** 返回编译好的pipeline，还没编译时在当前线程编译。失败或没注册时返回nullptr */
+  Pipeline *Get(const std::string &name);
+  /**
+   * 复制新的shader_code，和特化常量一起重新编译name，成功后替换旧的pipeline，失败时保留旧的
+   * NOTE: 之前Get到的指针会失效，调用前要保证GPU上没有使用旧pipeline的命令
+   */
+  bool Reload(const std::string &name, std::span<const uint32_t> shader_code, const SpecConstants &spec);
+  /** 所有注册过的pipeline的名字 */
+  std::vector<std::string> Names() const;
+  /** 启动num_threads个后台线程，按names的顺序编译 */
+  void Warmup(const std::vector<std::string> &names, uint32_t num_threads = 1);
+  /** 等待Warmup的线程结束 */
+  void WaitWarmup();
+  /** 所有已编译pipeline的编译耗时之和 */
+  double TotalCompileMs() const;
+  /** 停止warmup并销毁所有pipeline */
+  void Destroy();
+
+private:
+  struct Entry {
+    const DescriptorSet *desc;
+    std::span<const uint32_t> shader_code;
+    std::vector<uint32_t> owned_code;  // Reload时复制的shader_code
+    SpecConstants spec;
+    uint32_t push_constant_size;
+    Pipeline pipeline;
+    std::once_flag once;
+    bool success = false;
+    double compile_ms = 0;
+  };
+  /** 每个entry只编译一次，多个线程同时调用时其他线程等待 */
+  bool Compile(const std::string &name, Entry &entry);
+
+  const VkInfo *info_ = nullptr;
+  vk::PipelineCache cache_;
+  std::unordered_map<std::string, std::unique_ptr<Entry>> entries_;
+  std::vector<std::string> warmup_names_;
+  std::atomic<size_t> warmup_next_ = 0;
+  std::atomic<bool> stop_ = false;
+  std::vector<std::thread> warmup_threads_;
+};
@@ -0,0 +1,129 @@
+#include "shader_compiler.h"
+#ifdef USE_SHADERC
+#include <shaderc/shaderc.hpp>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static bool ReadText(const fs::path &path, string &text) {
+  ifstream file(path);
+  if (!file) return false;
+  stringstream ss;
+  ss << file.rdbuf();
+  text = ss.str();
+  return true;
+}
+
+/** 处理#include "xxx"：相对于当前文件查找，<xxx>相对于shader目录查找。顺便记录依赖 */
+class Includer : public shaderc::CompileOptions::IncluderInterface {
+public:
+  Includer(const fs::path &dir, set<string> &deps) : dir_(dir), deps_(deps) {}
+
+  shaderc_include_result *GetInclude(const char *requested_source, shaderc_include_type type,
+                                     const char *requesting_source, size_t include_depth) override {
+    fs::path path = type == shaderc_include_type_relative ? fs::path(requesting_source).parent_path() : dir_;
+    path = (path / requested_source).lexically_normal();
+    auto *data = new Data;
+    if (ReadText(path, data->content)) {
+      data->name = path.string();
+      deps_.insert(data->name);
+    } else {
+      data->content = "cannot open include file " + path.string();  // name为空表示失败
+    }
+    data->result = {data->name.c_str(), data->name.size(), data->content.c_str(), data->content.size(), data};
+    return &data->result;
+  }
+
+  void ReleaseInclude(shaderc_include_result *result) override {
+    delete static_cast<Data *>(result->user_data);
+  }
+
+private:
+  struct Data {
+    string name, content;
+    shaderc_include_result result;
+  };
+  fs::path dir_;
+  set<string> &deps_;
+};
+
+bool ShaderCompiler::Compile(const string &name, vector<uint32_t> &spv) {
+  auto path = (dir_ / (name + ".comp")).lexically_normal();
+  auto &deps = deps_[name];
+  deps = {path.string()};
+  string source;
+  if (!ReadText(path, source)) {
+    printf("[ERROR] Failed to read shader %s\n", path.string().c_str());
+    return false;
+  }
+  shaderc::Compiler compiler;
+  shaderc::CompileOptions options;
+  options.SetTargetEnvironment(shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_3);
+  options.SetIncluder(make_unique<Includer>(dir_, deps));
+  auto result = compiler.CompileGlslToSpv(source, shaderc_compute_shader, path.string().c_str(), options);
+  if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+    printf("[ERROR] Failed to compile shader %s:\n%s", name.c_str(), result.GetErrorMessage().c_str());
+    return false;
+  }
+  spv.assign(result.cbegin(), result.cend());
+  return true;
+}
+
+bool ShaderCompiler::DependsOn(const string &name, const vector<string> &files) const {
+  auto it = deps_.find(name);
+  if (it == deps_.end()) return true;
+  for (auto &file: files)
+    if (it->second.count(file)) return true;
+  return false;
+}
+
+ShaderWatcher::ShaderWatcher(const string &dir, int period_ms) : dir_(dir), period_ms_(period_ms) {
+  Scan(false);  // 记录初始的修改时间
+  thread_ = thread(&ShaderWatcher::Loop, this);
+}
+
+ShaderWatcher::~ShaderWatcher() {
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+vector<string> ShaderWatcher::TakeChanged() {
+  lock_guard<mutex> lock(mutex_);
+  vector<string> changed(changed_.begin(), changed_.end());
+  changed_.clear();
+  return changed;
+}
+
+void ShaderWatcher::Scan(bool record_changes) {
+  error_code ec;
+  for (auto &entry: fs::directory_iterator(dir_, ec)) {
+    if (!entry.is_regular_file(ec)) continue;
+    auto name = entry.path().lexically_normal().string();
+    auto mtime = entry.last_write_time(ec);
+    if (ec) continue;  // 编辑器保存时文件可能暂时不存在
+    auto it = mtimes_.find(name);
+    if (it != mtimes_.end() && it->second == mtime) continue;
+    mtimes_[name] = mtime;
+    if (record_changes) {
+      lock_guard<mutex> lock(mutex_);
+      changed_.insert(name);
+    }
+  }
+}
+
+void ShaderWatcher::Loop() {
+  unique_lock<mutex> lock(mutex_);
+  while (!cv_.wait_for(lock, chrono::milliseconds(period_ms_), [this]() { return stop_; })) {
+    lock.unlock();
+    Scan(true);
+    lock.lock();
+  }
+}
+#endif
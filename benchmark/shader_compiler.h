@@ -0,0 +1,52 @@
+#pragma once
+#ifdef USE_SHADERC
+#include <condition_variable>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * 运行时用shaderc把GLSL编译成SPIR-V，支持#include
+ * 同时记录每个shader用到的文件，文件修改后只需要重新编译受影响的shader
+ */
+class ShaderCompiler {
+public:
+  explicit ShaderCompiler(const std::string &shader_dir) : dir_(shader_dir) {}
+
+  /** 编译shader_dir下的name.comp */
+  bool Compile(const std::string &name, std::vector<uint32_t> &spv);
+  /** name的源文件或include的文件是否在files中。没编译过时返回true */
+  bool DependsOn(const std::string &name, const std::vector<std::string> &files) const;
+
+private:
+  std::filesystem::path dir_;
+  std::unordered_map<std::string, std::set<std::string>> deps_;  // shader名 -> 用到的文件
+};
+
+/** 后台线程定期检查目录下文件的修改时间 */
+class ShaderWatcher {
+public:
+  explicit ShaderWatcher(const std::string &dir, int period_ms = 500);
+  ~ShaderWatcher();
+
+  /** 取出上次调用之后修改过的文件 */
+  std::vector<std::string> TakeChanged();
+
+private:
+  void Scan(bool record_changes);
+  void Loop();
+
+  std::filesystem::path dir_;
+  int period_ms_;
+  std::unordered_map<std::string, std::filesystem::file_time_type> mtimes_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::set<std::string> changed_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+#endif
@@ -3,4 +3,11 @@ struct Input {
   vec3 y;
   int z;
 
+};
+
+// 与VkDispatchIndirectCommand内存布局一致，用于vkCmdDispatchIndirect
+struct DispatchIndirectCommand {
+  uint x;
+  uint y;
+  uint z;
 };
\ No newline at end of file
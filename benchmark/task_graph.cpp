@@ -0,0 +1,222 @@
+#include "task_graph.h"
+#include <algorithm>
+
+using namespace std;
+
+void TaskGraph::AddBuffer(const string &name, size_t elem_size, size_t num, vk::BufferUsageFlags usage,
+                          int alloc_usage) {
+  buffer_names_.push_back(name);
+  buffer_descs_[name] = {elem_size, num, usage, alloc_usage, false};
+}
+
+void TaskGraph::AddTransientBuffer(const string &name, size_t elem_size, size_t num, vk::BufferUsageFlags usage) {
+  buffer_names_.push_back(name);
+  buffer_descs_[name] = {elem_size, num, usage, MEMORY_GPU_ONLY, true};
+}
+
+void TaskGraph::AddTask(const string &name, span<const uint32_t> shader_code,
+                        const vector<pair<string, Access>> &bindings, uint32_t x, uint32_t y, uint32_t z) {
+  tasks_.push_back({name, shader_code, bindings, {x, y, z}, ""});
+}
+
+void TaskGraph::AddIndirectTask(const string &name, span<const uint32_t> shader_code,
+                                const vector<pair<string, Access>> &bindings, const string &args) {
+  tasks_.push_back({name, shader_code, bindings, {0, 0, 0}, args});
+}
+
+void TaskGraph::SetPushConstants(const string &task, const vector<uint32_t> &data) {
+  for (auto &t: tasks_)
+    if (t.name == task)
+      t.push_constants = data;
+}
+
+vector<BufferAccess> TaskGraph::Accesses(const Task &task) {
+  vector<BufferAccess> accesses;
+  for (auto &binding: task.bindings)
+    accesses.push_back({&buffers_[binding.first], binding.second});
+  if (!task.indirect_args.empty())
+    accesses.push_back({&buffers_[task.indirect_args], Access::eIndirect});
+  return accesses;
+}
+
+void TaskGraph::Schedule() {
+  //! 按添加顺序推导依赖：读依赖上一次写，写依赖上一次写和之后的所有读
+  unordered_map<string, int> last_writer;
+  unordered_map<string, vector<int>> readers;
+  for (int i = 0; i < tasks_.size(); i++) {
+    auto &task = tasks_[i];
+    auto uses = task.bindings;
+    if (!task.indirect_args.empty())
+      uses.push_back({task.indirect_args, Access::eIndirect});
+    task.level = 0;
+    for (auto &use: uses) {
+      bool is_write = use.second == Access::eWrite || use.second == Access::eReadWrite;
+      if (last_writer.count(use.first))
+        task.level = max(task.level, tasks_[last_writer[use.first]].level + 1);
+      if (is_write)
+        for (int r: readers[use.first])
+          task.level = max(task.level, tasks_[r].level + 1);
+    }
+    for (auto &use: uses) {
+      if (use.second == Access::eWrite || use.second == Access::eReadWrite) {
+        last_writer[use.first] = i;
+        readers[use.first].clear();
+      } else {
+        readers[use.first].push_back(i);
+      }
+    }
+  }
+  //! 分层，同一层的task之间没有barrier，可以重叠执行
+  // NOTE: VkInfo只有一个compute queue，所以所有层都提交到这个queue上
+  levels_.clear();
+  for (int i = 0; i < tasks_.size(); i++) {
+    auto level = tasks_[i].level;
+    if (levels_.size() <= level) levels_.resize(level + 1);
+    levels_[level].push_back(i);
+    auto uses = tasks_[i].bindings;
+    if (!tasks_[i].indirect_args.empty())
+      uses.push_back({tasks_[i].indirect_args, Access::eIndirect});
+    for (auto &use: uses) {
+      auto &desc = buffer_descs_[use.first];
+      desc.first_level = desc.first_level < 0 ? level : min(desc.first_level, level);
+      desc.last_level = max(desc.last_level, level);
+    }
+  }
+}
+
+bool TaskGraph::CreateBuffers() {
+  //! 给transient buffer分配alias slot：按第一次使用排序，复用已经不再使用的slot
+  vector<string> transients;
+  for (auto &name: buffer_names_)
+    if (buffer_descs_[name].transient && buffer_descs_[name].first_level >= 0)
+      transients.push_back(name);
+  sort(transients.begin(), transients.end(), [&](const string &a, const string &b) {
+    return buffer_descs_[a].first_level < buffer_descs_[b].first_level;
+  });
+  vector<int> slot_last_level;
+  vector<size_t> slot_size;
+  vector<vk::BufferUsageFlags> slot_usage;
+  for (auto &name: transients) {
+    auto &desc = buffer_descs_[name];
+    for (int s = 0; s < slot_last_level.size(); s++)
+      if (slot_last_level[s] < desc.first_level) {
+        desc.alias_slot = s;
+        break;
+      }
+    if (desc.alias_slot < 0) {
+      desc.alias_slot = slot_last_level.size();
+      slot_last_level.push_back(-1);
+      slot_size.push_back(0);
+      slot_usage.push_back({});
+    }
+    slot_last_level[desc.alias_slot] = desc.last_level;
+    slot_size[desc.alias_slot] = max(slot_size[desc.alias_slot], desc.elem_size * desc.num);
+    slot_usage[desc.alias_slot] |= desc.usage;
+  }
+  //! 创建buffer
+  bool create_success = true;
+  alias_backings_.resize(slot_size.size());
+  for (int s = 0; s < slot_size.size(); s++)
+    create_success &= alias_backings_[s].Init(*info_, 1, slot_size[s], slot_usage[s], MEMORY_GPU_ONLY);
+  if (!create_success) return false;
+  for (auto &name: buffer_names_) {
+    auto &desc = buffer_descs_[name];
+    if (desc.alias_slot >= 0)
+      create_success &= buffers_[name].InitAliased(*info_, alias_backings_[desc.alias_slot], desc.elem_size,
+        desc.num, desc.usage);
+    else
+      create_success &= buffers_[name].Init(*info_, desc.elem_size, desc.num, desc.usage, desc.alloc_usage);
+  }
+  printf("[INFO] Task graph: %zu tasks in %zu levels, %zu transient buffers in %zu memory slots\n", tasks_.size(),
+    levels_.size(), transients.size(), slot_size.size());
+  return create_success;
+}
+
+bool TaskGraph::Record() {
+  CommandRecorder recorder;
+  recorder.Begin(cmd_buffer_, false);
+  for (int l = 0; l < levels_.size(); l++) {
+    //! 内存被其他transient buffer复用时，需要等之前的访问都结束
+    bool alias_handover = false;
+    for (auto &name: buffer_names_) {
+      auto &desc = buffer_descs_[name];
+      alias_handover |= desc.alias_slot >= 0 && desc.first_level == l && l > 0;
+    }
+    if (alias_handover) {
+      // NOTE: recorder按VkBuffer跟踪状态，看不到复用同一块内存的buffer之间的依赖
+      // 之前的buffer可能作为indirect参数被读，所以也要包含DRAW_INDIRECT阶段
+      auto access = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead |
+                    vk::AccessFlagBits::eIndirectCommandRead;
+      auto stages = vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eDrawIndirect;
+      vk::MemoryBarrier barrier(access, access);
+      recorder.cmd.pipelineBarrier(stages, stages, {}, barrier, nullptr, nullptr);
+    }
+    //! 同一层的task只需要在开始前同步一次
+    vector<BufferAccess> level_accesses;
+    for (int t: levels_[l]) {
+      auto accesses = Accesses(tasks_[t]);
+      level_accesses.insert(level_accesses.end(), accesses.begin(), accesses.end());
+    }
+    recorder.Sync(level_accesses);
+    for (int t: levels_[l]) {
+      auto &task = tasks_[t];
+      if (!task.push_constants.empty())
+        recorder.cmd.pushConstants<uint32_t>(pipelines_[task.name].layout, vk::ShaderStageFlagBits::eCompute, 0,
+          task.push_constants);
+      if (task.indirect_args.empty())
+        recorder.Dispatch(pipelines_[task.name], desc_sets_[task.name], task.grid[0], task.grid[1], task.grid[2], {});
+      else
+        recorder.DispatchIndirect(pipelines_[task.name], desc_sets_[task.name], buffers_[task.indirect_args], {});
+    }
+  }
+  recorder.End();
+  printf("[INFO] Task graph: %d pipeline barriers recorded\n", recorder.num_barriers);
+  return true;
+}
+
+bool TaskGraph::Compile(const VkInfo &info) {
+  info_ = &info;
+  Schedule();
+  if (!CreateBuffers()) {
+    printf("[FATAL] Failed to create buffers of task graph.\n");
+    return false;
+  }
+  bool create_success = true;
+  for (auto &task: tasks_) {
+    vector<Buffer *> bindings;
+    for (auto &binding: task.bindings)
+      bindings.push_back(&buffers_[binding.first]);
+    create_success &= desc_sets_[task.name].Init(info, bindings);
+    create_success &= pipelines_[task.name].Init(info, desc_sets_[task.name], task.shader_code, nullptr, {},
+      uint32_t(task.push_constants.size() * sizeof(uint32_t)));
+  }
+  if (!create_success) {
+    printf("[FATAL] Failed to create descriptors or pipelines of task graph.\n");
+    return false;
+  }
+  vk::CommandBufferAllocateInfo alloc_info(info.cmd_pool, vk::CommandBufferLevel::ePrimary, 1);
+  VK_CHECK(info.device.allocateCommandBuffers(&alloc_info, &cmd_buffer_));
+  vk::FenceCreateInfo fence_info;
+  VK_CHECK(info.device.createFence(&fence_info, nullptr, &fence_));
+  return Record();
+}
+
+bool TaskGraph::Execute() {
+  vk::SubmitInfo submit_info;
+  submit_info.setCommandBufferCount(1).setPCommandBuffers(&cmd_buffer_);
+  VK_CHECK(info_->queue.submit(1, &submit_info, fence_));
+  VK_CHECK(info_->device.waitForFences(1, &fence_, VK_TRUE, UINT64_MAX));
+  VK_CHECK(info_->device.resetFences(1, &fence_));
+  return true;
+}
+
+void TaskGraph::Destroy() {
+  if (!info_) return;
+  info_->device.destroyFence(fence_);
+  info_->device.freeCommandBuffers(info_->cmd_pool, cmd_buffer_);
+  pipelines_.clear();
+  desc_sets_.clear();
+  buffers_.clear();
+  alias_backings_.clear();
+  info_ = nullptr;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include "benchmark.h"
+
+/**
+ * 声明式的compute计算图：节点是kernel，边是buffer依赖
+ * 先用AddBuffer/AddTask描述，Compile一次生成command buffer（barrier、transient内存复用），之后可以反复Execute
+ */
+class TaskGraph {
+public:
+  ~TaskGraph() { Destroy(); }
+
+  /** 图外部可见的buffer，可以SetData/GetData */
+  void AddBuffer(const std::string &name, size_t elem_size, size_t num, vk::BufferUsageFlags usage,
+    int alloc_usage);
+  /** 只在图内部使用的GPU buffer，生命周期不重叠的transient buffer会共用同一块内存 */
+  void AddTransientBuffer(const std::string &name, size_t elem_size, size_t num, vk::BufferUsageFlags usage);
+  /** bindings按顺序对应shader中的binding */
+  void AddTask(const std::string &name, std::span<const uint32_t> shader_code,
+    const std::vector<std::pair<std::string, Access>> &bindings, uint32_t x, uint32_t y = 1, uint32_t z = 1);
+  /** grid size从args buffer中读取（VkDispatchIndirectCommand） */
+  void AddIndirectTask(const std::string &name, std::span<const uint32_t> shader_code,
+    const std::vector<std::pair<std::string, Access>> &bindings, const std::string &args);
+  /** 设置task的push constant，需要在Compile之前调用 */
+  void SetPushConstants(const std::string &task, const std::vector<uint32_t> &data);
+
+  bool Compile(const VkInfo &info);
+  /** 提交编译好的command buffer并等待完成 */
+  bool Execute();
+  Buffer &GetBuffer(const std::string &name) { return buffers_[name]; }
+  void Destroy();
+
+private:
+  struct BufferDesc {
+    size_t elem_size;
+    size_t num;
+    vk::BufferUsageFlags usage;
+    int alloc_usage;
+    bool transient;
+    int first_level = -1, last_level = -1;  // 用到该buffer的第一层和最后一层
+    int alias_slot = -1;
+  };
+  struct Task {
+    std::string name;
+    std::span<const uint32_t> shader_code;  // NOTE: 不复制，需要在图的生命周期内有效
+    std::vector<std::pair<std::string, Access>> bindings;
+    uint32_t grid[3];
+    std::string indirect_args;  // 非空时使用dispatchIndirect
+    int level = 0;              // 同一层的task互不依赖
+    std::vector<uint32_t> push_constants;
+  };
+  /** 根据task的添加顺序推导依赖，并按层排序 */
+  void Schedule();
+  /** 创建buffer，生命周期不重叠的transient buffer共用内存 */
+  bool CreateBuffers();
+  bool Record();
+  std::vector<BufferAccess> Accesses(const Task &task);
+
+  const VkInfo *info_ = nullptr;
+  std::vector<Task> tasks_;
+  std::vector<std::string> buffer_names_;  // 保持添加顺序
+  std::unordered_map<std::string, BufferDesc> buffer_descs_;
+  std::unordered_map<std::string, Buffer> buffers_;
+  std::vector<Buffer> alias_backings_;  // 每个alias slot的实际内存
+  std::unordered_map<std::string, DescriptorSet> desc_sets_;
+  std::unordered_map<std::string, Pipeline> pipelines_;
+  std::vector<std::vector<int>> levels_;
+  vk::CommandBuffer cmd_buffer_;
+  vk::Fence fence_;
+};
@@ -0,0 +1,64 @@
+#include "benchmark.h"
+
+using namespace std;
+
+/** 不需要GPU：只检查CommandRecorder::PlanBarriers算出的barrier */
+
+#define EXPECT(cond) do { if (!(cond)) { printf("[ERROR] %s:%d: %s\n", __FILE__, __LINE__, #cond); return false; } } while (0)
+
+/** buffer句柄只用来区分状态，不创建真正的buffer。析构前会把句柄清空，~Buffer不会调用vulkan */
+struct FakeBuffer : Buffer {
+  explicit FakeBuffer(uintptr_t handle) {
+    buffer = vk::Buffer((VkBuffer)handle);
+    usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer;
+  }
+  ~FakeBuffer() { buffer = nullptr; }
+};
+
+/** 写 -> 作为indirect参数读 -> 再写：第二次写要等DRAW_INDIRECT阶段的读完成 */
+static bool TestWriteIndirectWrite() {
+  CommandRecorder recorder;
+  FakeBuffer fake_args(1);
+  Buffer *args = &fake_args;
+  vector<vk::BufferMemoryBarrier> barriers;
+  vk::PipelineStageFlags src, dst;
+
+  recorder.PlanBarriers({{args, Access::eWrite}}, barriers, src, dst);
+  EXPECT(barriers.empty());
+
+  recorder.PlanBarriers({{args, Access::eIndirect}}, barriers, src, dst);
+  EXPECT(barriers.size() == 1);
+  EXPECT(dst & vk::PipelineStageFlagBits::eDrawIndirect);
+  EXPECT(barriers[0].dstAccessMask & vk::AccessFlagBits::eIndirectCommandRead);
+
+  barriers.clear();
+  src = dst = {};
+  recorder.PlanBarriers({{args, Access::eWrite}}, barriers, src, dst);
+  EXPECT(barriers.size() == 1);
+  EXPECT(src & vk::PipelineStageFlagBits::eComputeShader);
+  EXPECT(src & vk::PipelineStageFlagBits::eDrawIndirect);
+  EXPECT(barriers[0].srcAccessMask == vk::AccessFlagBits::eShaderWrite);
+  return true;
+}
+
+/** 只读之间不需要barrier，不相关的buffer互不影响 */
+static bool TestIndependentReads() {
+  CommandRecorder recorder;
+  FakeBuffer fake_a(2), fake_b(3);
+  Buffer *a = &fake_a, *b = &fake_b;
+  vector<vk::BufferMemoryBarrier> barriers;
+  vk::PipelineStageFlags src, dst;
+
+  recorder.PlanBarriers({{a, Access::eRead}, {b, Access::eWrite}}, barriers, src, dst);
+  recorder.PlanBarriers({{a, Access::eRead}}, barriers, src, dst);
+  EXPECT(barriers.empty());
+  return true;
+}
+
+int main() {
+  bool success = true;
+  success &= TestWriteIndirectWrite();
+  success &= TestIndependentReads();
+  printf("[INFO] command_recorder_test %s\n", success ? "passed" : "FAILED");
+  return success ? 0 : 1;
+}
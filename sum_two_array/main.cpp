@@ -139,8 +139,13 @@ int main() {
   pipe_layout_create_info.setSetLayouts(des_set_layout_array);
   vk::PipelineLayout pipe_layout = device.createPipelineLayout(pipe_layout_create_info);
   //! 创建pipeline
+  // 用特化常量设置block size，同一个SPIR-V可以按设备选择不同的大小
+  const uint32_t local_size = min(128u, phy_device_prop.limits.maxComputeWorkGroupSize[0]);
+  vk::SpecializationMapEntry spec_entry(/*constantID*/0, /*offset*/0, sizeof(uint32_t));
+  vk::SpecializationInfo spec_info(1, &spec_entry, sizeof(uint32_t), &local_size);
   vk::PipelineShaderStageCreateInfo shader_stage_create_info;
-  shader_stage_create_info.setStage(vk::ShaderStageFlagBits::eCompute).setModule(shader_module).setPName("main");
+  shader_stage_create_info.setStage(vk::ShaderStageFlagBits::eCompute).setModule(shader_module).setPName("main")
+      .setPSpecializationInfo(&spec_info);
   vk::ComputePipelineCreateInfo pipe_create_info;
   pipe_create_info.setLayout(pipe_layout).setStage(shader_stage_create_info);
   vk::PipelineCache pipe_cache = device.createPipelineCache({});  // NOTE: 可选
@@ -189,7 +194,7 @@ int main() {
   cmd_buff.begin(cmd_begin_info);
   cmd_buff.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
   cmd_buff.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipe_layout, 0, {des_set}, {});
-  cmd_buff.dispatch(element_num, 1, 1);
+  cmd_buff.dispatch((element_num + local_size - 1) / local_size, 1, 1);  // grid size跟着block size变
   cmd_buff.end();
   //! 提交cmd
   vk::SubmitInfo submit_info;